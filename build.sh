@@ -1,6 +1,21 @@
 cd src/
-g++ -c -g -Wall -std=c++20 main.cpp
-g++ -c -g -Wall -std=c++20 instruction_set.cpp
-g++ -c -g -std=c++20 tests.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions main.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions instruction_set.cpp
+g++ -c -g -std=c++20 -fno-exceptions tests.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions recompiler.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions fusion.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions breakpoints.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions timeline.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions bench.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions shared_mem.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions pacer.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions perf_counters.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions profiler.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions batch.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions job_server.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions fuzzer.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions wcet.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions test_matrix.cpp
+g++ -c -g -Wall -std=c++20 -fno-exceptions bus.cpp
 cd ../
-g++ -o emulator src/main.o src/instruction_set.o src/tests.o
\ No newline at end of file
+g++ -o emulator src/main.o src/instruction_set.o src/tests.o src/recompiler.o src/fusion.o src/breakpoints.o src/timeline.o src/bench.o src/shared_mem.o src/pacer.o src/perf_counters.o src/profiler.o src/batch.o src/job_server.o src/fuzzer.o src/wcet.o src/test_matrix.o src/bus.o -lrt -pthread
\ No newline at end of file
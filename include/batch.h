@@ -0,0 +1,80 @@
+#ifndef EM6502_BATCH_H_
+#define EM6502_BATCH_H_
+
+#include "cpu.h"
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    enum class expectation_targets : Byte
+    {
+        REASON,     // Why the job stopped, a halt_reason_name() or "instruction_limit"
+        PC,
+        A,
+        X,
+        Y,
+        MEMORY      // The byte at address
+    };
+
+    /** End condition a job must meet to pass */
+    struct EXPECTATION
+    {
+        expectation_targets target;
+        Word address;
+        u32 value;
+        std::string reason;
+    };
+
+    /** Program image to run, with its limits and expected end conditions */
+    struct BATCH_JOB
+    {
+        std::string program;
+        Word load_address = 0x0200;
+        Word entry = 0x0200;
+        u64 max_cycles = 10000000;
+        u64 max_instructions = 0;   // 0 for no limit
+        std::vector<EXPECTATION> expectations;
+    };
+
+    struct BATCH_RESULT
+    {
+        bool loaded = false;
+        u64 cycles = 0;
+        u64 instructions = 0;
+        const char* reason = "";                // halt_reason_name() or "instruction_limit"
+        std::vector<const char*> failed;        // Names of the expectations not met
+        double wall_us = 0;
+    };
+
+    /**
+     * @brief parses a manifest line: "<program> <load> <entry> [key=value...]" where the keys are
+     * cycles and instructions for the limits, then reason, pc, a, x, y or a memory address (e.g. $0200=$12)
+     * for the expected end conditions
+     *
+     * @param job: BATCH_JOB object holding the defaults, filled from the line
+     *
+     * @return false if the line is malformed
+     */
+    bool parse_job(const char* line, BATCH_JOB& job);
+
+    /**
+     * @brief runs the program already in memory from PC until a limit is reached or the CPU halts,
+     * then checks the expected end conditions
+     *
+     * The CPU is run in slices of at most twice the remaining instructions in cycles. No instruction takes
+     * less than 2 cycles, so the instruction limit is never passed.
+     */
+    BATCH_RESULT execute_job(const BATCH_JOB& job, CPU& cpu, MEM& memory);
+
+    /**
+     * @brief resets the registers and clears the memory, loads the program of the job and runs it with execute_job
+     *
+     * The handlers are kept, so the CPU must have been set up once with CPU::reset.
+     */
+    BATCH_RESULT run_job(const BATCH_JOB& job, CPU& cpu, MEM& memory);
+
+    /** "run" command of the emulator */
+    int run_command(int argc, char** argv);
+}
+#endif // EM6502_BATCH_H_
\ No newline at end of file
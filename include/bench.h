@@ -0,0 +1,18 @@
+#ifndef EM6502_BENCH_H_
+#define EM6502_BENCH_H_
+
+#include "cpu.h"
+
+namespace EM6502
+{
+    /**
+     * @brief fills the memory with a repeating block of loads that runs forever as PC wraps around
+     *
+     * @param writes: also store to memory with the undocumented SAX, which needs illegal_opcode_policies::UNDOCUMENTED
+     */
+    void load_bench_workload(MEM& memory, bool writes);
+
+    /** "bench" command of the emulator */
+    int bench_command(int argc, char** argv);
+}
+#endif // EM6502_BENCH_H_
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef EM6502_BREAKPOINTS_H_
+#define EM6502_BREAKPOINTS_H_
+
+#include "utils.h"
+#include "instruction_set.h"
+#include <bitset>
+
+namespace EM6502
+{
+    struct MEMORY_ACCESS
+    {
+        Word address;
+        bool write;
+    };
+
+    /**
+     * @brief execution breakpoints and memory watchpoints, one bit per address
+     *
+     * CPU::exec only checks them while at least one is armed, otherwise it runs a loop without checks.
+     */
+    struct BREAKPOINTS
+    {
+        std::bitset<MAX_MEM> execute;
+        std::bitset<MAX_MEM> read;
+        std::bitset<MAX_MEM> write;
+
+        /** Halts before the instruction at the address runs */
+        void set_breakpoint(Word address, bool armed = true)
+        {
+            execute[address] = armed;
+            update_armed();
+        }
+
+        /** Halts after an instruction reads and/or writes the address */
+        void set_watchpoint(Word address, bool on_read, bool on_write)
+        {
+            read[address] = on_read;
+            write[address] = on_write;
+            update_armed();
+        }
+
+        void clear()
+        {
+            execute.reset();
+            read.reset();
+            write.reset();
+            update_armed();
+        }
+
+        bool armed() const
+        {
+            return is_armed;
+        }
+
+    private:
+        bool is_armed = false;
+
+        void update_armed()
+        {
+            is_armed = execute.any() || read.any() || write.any();
+        }
+    };
+
+    /**
+     * @brief finds the data memory an instruction is about to access, instruction bytes excluded
+     *
+     * @param cpu: CPU object with PC on the opcode
+     * @param info: decoding data of the opcode
+     * @param accesses: receives the accesses in bus order
+     *
+     * @return the number of accesses, at most 3
+     */
+    u32 memory_accesses(const CPU& cpu, const MEM& memory, const INSTRUCTION_INFO& info, MEMORY_ACCESS accesses[3]);
+}
+#endif // EM6502_BREAKPOINTS_H_
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef EM6502_BUS_H_
+#define EM6502_BUS_H_
+
+#include "utils.h"
+#include "instruction_set.h"
+#include <stdint.h>
+#include <vector>
+
+namespace EM6502
+{
+    enum class bus_cycle_types : Byte
+    {
+        OPCODE_FETCH,
+        OPERAND_FETCH,  // Instruction byte after the opcode
+        READ,           // Data read
+        WRITE,          // Data write
+        DUMMY_READ      // Read whose data the CPU discards while it computes an address or waits
+    };
+
+    /** One cycle on the address and data bus */
+    struct BUS_CYCLE
+    {
+        Word address;
+        Byte data;
+        bus_cycle_types type;
+    };
+
+    /** Most cycles taken by one instruction */
+    static constexpr u32 BUS_MAX_CYCLES = 8;
+
+    /**
+     * @brief called with each cycle an active device sees
+     *
+     * @param cycle: number of the cycle since the bus was created, fast-forwarded cycles included
+     */
+    typedef void(*BUS_LISTENER)(void* context, u64 cycle, const BUS_CYCLE& access);
+
+    struct BUS_DEVICE
+    {
+        BUS_LISTENER listener;
+        void* context;                  // Passed to the listener
+        bool active = true;             // Cycles are only presented to active devices
+        u64 wake_cycle = UINT64_MAX;    // An inactive device becomes active at this cycle
+    };
+
+    /**
+     * @brief devices that see the bus cycle by cycle
+     *
+     * CPU::exec only steps cycle by cycle while a device is active. Otherwise it runs the instruction
+     * level loop, stopping early at the wake cycle of a sleeping device, and only advances the cycle count.
+     * The cycles of an instruction are presented once it has run, in bus order with their own cycle
+     * numbers; devices observe the bus, they don't drive its data.
+     */
+    struct BUS
+    {
+        std::vector<BUS_DEVICE*> devices;
+        u64 cycle = 0;      // Cycles run so far
+
+        void attach(BUS_DEVICE& device)
+        {
+            devices.push_back(&device);
+        }
+
+        void detach(BUS_DEVICE& device)
+        {
+            for (size_t i = 0; i < devices.size(); i++)
+                if (devices[i] == &device)
+                    devices.erase(devices.begin() + i--);
+        }
+
+        /** @return true if a device needs to see each cycle */
+        bool stepping() const
+        {
+            for (const BUS_DEVICE* Device : devices)
+                if (Device->active)
+                    return true;
+            return false;
+        }
+
+        /** Earliest wake cycle of the inactive devices, UINT64_MAX if none */
+        u64 next_wake() const
+        {
+            u64 Wake = UINT64_MAX;
+            for (const BUS_DEVICE* Device : devices)
+                if (!Device->active && Device->wake_cycle < Wake)
+                    Wake = Device->wake_cycle;
+            return Wake;
+        }
+
+        /** Activates the devices whose wake cycle has come */
+        void wake()
+        {
+            for (BUS_DEVICE* Device : devices)
+                if (!Device->active && Device->wake_cycle <= cycle)
+                {
+                    Device->active = true;
+                    Device->wake_cycle = UINT64_MAX;
+                }
+        }
+
+        /**
+         * @brief presents the cycles of an instruction that has just run to each active device in turn
+         *
+         * @param trace: cycles found by bus_cycles() before the instruction ran, the data of writes
+         * is read back from the memory
+         * @param used: cycles the instruction took, added to the cycle count
+         */
+        void present(BUS_CYCLE trace[], u32 count, const MEM& memory, s32 used);
+    };
+
+    /**
+     * @brief finds the cycles an instruction is about to put on the bus, from its addressing mode
+     *
+     * @param cpu: CPU object with PC on the opcode
+     * @param info: decoding data of the opcode, nullptr for an illegal opcode run as a NOP
+     * @param trace: receives the cycles in bus order, the data of writes isn't known yet
+     *
+     * @return the number of cycles
+     */
+    u32 bus_cycles(const CPU& cpu, const MEM& memory, const INSTRUCTION_INFO* info, BUS_CYCLE trace[BUS_MAX_CYCLES]);
+
+    /** Same for the entry sequence of an IRQ or NMI about to be taken */
+    u32 interrupt_cycles(const CPU& cpu, const MEM& memory, Word vector, BUS_CYCLE trace[BUS_MAX_CYCLES]);
+}
+#endif // EM6502_BUS_H_
\ No newline at end of file
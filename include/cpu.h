@@ -4,15 +4,92 @@
 #include "utils.h"
 #include "mem.h"
 #include "instruction_set.h"
+#include "breakpoints.h"
+#include "bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 namespace EM6502
 {
+    struct FUSION_PROFILE;
+
+    enum class halt_reasons : Byte
+    {
+        BUDGET_EXHAUSTED,   // The requested cycles were used
+        ILLEGAL_OPCODE,     // An opcode that isn't handled under the illegal opcode policy
+        BREAKPOINT,         // An armed execution breakpoint was reached
+        BRK,                // A BRK instruction was reached
+        WATCHPOINT          // An armed memory watchpoint was accessed
+    };
+
+    enum class illegal_opcode_policies : Byte
+    {
+        HALT,           // Stop and report the opcode
+        NOP,            // Skip it as a 1 byte, 2 cycles NOP
+        UNDOCUMENTED    // Emulate the stable NMOS loads and stores LAX and SAX and the multi-byte NOPs, halt on the others
+                        // (SLO, RLA, SRE, RRA, DCP, ISC, the unstable ones and the ones that jam the CPU)
+    };
+
+    /** Outcome of CPU::exec */
+    struct EXEC_RESULT
+    {
+        s32 cycles;             // Number of cycles used
+        u32 instructions;       // Number of instructions retired
+        halt_reasons reason;
+        Word address;           // PC of the instruction halted on, or the address of the watchpoint hit
+    };
+
+    /** Outcome of a run made of many CPU::exec calls, whose totals can exceed what EXEC_RESULT holds */
+    struct RUN_RESULT
+    {
+        u64 cycles;
+        u64 instructions;
+        halt_reasons reason;    // Reason of the last CPU::exec call
+        Word address;
+    };
+
+    /** Lowercase name of a halt reason, as used in command line options and reports */
+    inline const char* halt_reason_name(halt_reasons reason)
+    {
+        switch (reason)
+        {
+            case halt_reasons::BUDGET_EXHAUSTED: return "budget_exhausted";
+            case halt_reasons::ILLEGAL_OPCODE: return "illegal_opcode";
+            case halt_reasons::BREAKPOINT: return "breakpoint";
+            case halt_reasons::BRK: return "brk";
+            case halt_reasons::WATCHPOINT: return "watchpoint";
+            default: return "?";
+        }
+    }
+
+    /** Copy of the programmer visible state of a CPU */
+    struct REGISTERS
+    {
+        Word PC;
+        Byte SP;
+        Register A, X, Y;
+        Byte P;     // Status flags packed as NV-BDIZC
+    };
+
+    /** Copy of the interrupt inputs of a CPU, which decide when exec takes an interrupt */
+    struct INTERRUPT_LINES
+    {
+        u32 irq_lines;
+        bool nmi_line;
+        bool nmi_pending;
+    };
+
+    /** Subroutine call tracked by JSR */
+    struct CALL_FRAME
+    {
+        Word target;            // Address of the subroutine
+        Word return_address;    // Address pushed on the stack, RTS continues after it
+    };
+
     struct CPU
     {
         Word PC;        // Program counter
-        Word SP;        // Stack pointer // ToDo: switch to Byte
+        Byte SP;        // Stack pointer, the stack is page one and grows down from $01FF
 
         Register A, X, Y;   // Registers
 
@@ -24,40 +101,212 @@ namespace EM6502
         Byte V : 1; // Status flag {Overflow}
         Byte N : 1; // Status flag {Negative}
 
+        illegal_opcode_policies illegal_opcode_policy = illegal_opcode_policies::HALT;
+
+        static constexpr Word NMI_VECTOR = 0xFFFA;
+        static constexpr Word IRQ_VECTOR = 0xFFFE;     // Also used by BRK
+
+        u32 irq_lines = 0;              // One bit per source holding the IRQ line, level triggered
+        bool nmi_line = false;
+        bool nmi_pending = false;       // Latched on the rising edge of nmi_line, cleared when taken
+        bool halt_on_brk = true;        // BRK halts exec with halt_reasons::BRK instead of running as an interrupt
+
+        /**
+         * The run loop runs instructions while cycles > interrupt_deadline: 0 normally, so it is the budget
+         * check, and above any budget while an interrupt can be taken, so the same check catches it.
+         */
+        s32 interrupt_deadline = 0;
+
+        BREAKPOINTS* breakpoints = nullptr;     // Checked by exec while any is armed
+        BUS* bus = nullptr;                     // Stepped cycle by cycle by exec while a device is active
+
+        u32 fused_retired = 0;  // Instructions retired by fused handlers after their first one
+
+        static constexpr u32 CALL_STACK_SIZE = 64;
+        CALL_FRAME call_stack[CALL_STACK_SIZE];     // Shadow of the return addresses on the stack, outermost call first, only the first CALL_STACK_SIZE are kept
+        u32 call_depth = 0;
+
+        void push_call(Word target, Word return_address)
+        {
+            if (call_depth < CALL_STACK_SIZE)
+                call_stack[call_depth] = { target, return_address };
+            call_depth++;
+        }
+
+        /**
+         * @brief pops the frames down to the one RTS returns from
+         * 
+         * A return address that no tracked frame pushed, e.g. one pushed by the program to jump with RTS,
+         * leaves the shadow stack as it is.
+         */
+        void pop_call(Word return_address)
+        {
+            if (call_depth > CALL_STACK_SIZE)
+            {
+                call_depth--;
+                return;
+            }
+            for (u32 Depth = call_depth; Depth > 0; Depth--)
+            {
+                if (call_stack[Depth - 1].return_address == return_address)
+                {
+                    call_depth = Depth - 1;
+                    return;
+                }
+            }
+        }
+
+        /** @return where the next RTS most likely goes, -1 if no tracked call is pending */
+        s32 predicted_return() const
+        {
+            if (call_depth == 0 || call_depth > CALL_STACK_SIZE)
+                return -1;
+            return (Word)(call_stack[call_depth - 1].return_address + 1);
+        }
+
     private:
         std::map<opcodes, INSTRUCTION> instructions;
+        std::map<opcodes, INSTRUCTION> dispatch;   // instructions with the selected fused handlers swapped in
+        std::map<Byte, INSTRUCTION> undocumented_instructions;
+
+        bool resume_from_breakpoint = false;    // The last exec halted on the breakpoint at PC
 
         void set_instructions()
         {
-            // ADD INSTRUCTIONS FUNCTION TO MAP USING OPCODE AS KEY TO ENABLE HANDLING OF INSTRUCTION
-            instructions[opcodes::INS_NOP] = NOP;
-            instructions[opcodes::INS_LDA_IM] = LDA_IM;
-            instructions[opcodes::INS_LDA_ZP] = LDA_ZP;
-            instructions[opcodes::INS_LDA_ZPX] = LDA_ZPX;
-            instructions[opcodes::INS_LDA_ABS] = LDA_ABS;
-            instructions[opcodes::INS_LDA_ABSX] = LDA_ABSX;
-            instructions[opcodes::INS_LDA_ABSY] = LDA_ABSY;
-            instructions[opcodes::INS_LDA_INDX] = LDA_INDX;
-            instructions[opcodes::INS_LDA_INDY] = LDA_INDY;
-            instructions[opcodes::INS_LDX_IM] = LDX_IM;
-            instructions[opcodes::INS_LDX_ZP] = LDX_ZP;
-            instructions[opcodes::INS_LDX_ZPY] = LDX_ZPY;
-            instructions[opcodes::INS_LDX_ABS] = LDX_ABS;
-            instructions[opcodes::INS_LDX_ABSY] = LDX_ABSY;
-            instructions[opcodes::INS_LDY_IM] = LDY_IM;
-            instructions[opcodes::INS_LDY_ZP] = LDY_ZP;
-            instructions[opcodes::INS_LDY_ZPX] = LDY_ZPX;
-            instructions[opcodes::INS_LDY_ABS] = LDY_ABS;
-            instructions[opcodes::INS_LDY_ABSX] = LDY_ABSX;
-            instructions[opcodes::INS_JSR] = JSR;
+            for (const INSTRUCTION_ENTRY& Entry : instruction_table())
+                instructions[(opcodes)Entry.opcode] = Entry.handler;
+            // BRK is run by exec_unhandled, which halts on it unless halt_on_brk is cleared
+
+            // Only used with illegal_opcode_policies::UNDOCUMENTED
+            for (const INSTRUCTION_ENTRY& Entry : undocumented_instruction_table())
+                undocumented_instructions[Entry.opcode] = Entry.handler;
+
+            dispatch = instructions;
+        }
+
+        /**
+         * @brief handles an opcode that has no handler, the fetch of the opcode is already counted
+         * 
+         * @return false if execution must halt, PC and cycles are then restored to before the fetch
+         */
+        bool exec_unhandled(Byte opcode, s32& cycles, MEM& memory, EXEC_RESULT& result)
+        {
+            if (opcode == (Byte)opcodes::INS_BRK && !halt_on_brk)
+            {
+                BRK(this, cycles, &memory);
+                return true;
+            }
+            if (opcode != (Byte)opcodes::INS_BRK)
+            {
+                if (illegal_opcode_policy == illegal_opcode_policies::NOP)
+                {
+                    cycles--;
+                    return true;
+                }
+                if (illegal_opcode_policy == illegal_opcode_policies::UNDOCUMENTED && undocumented_instructions.count(opcode))
+                {
+                    undocumented_instructions[opcode](this, cycles, &memory);
+                    return true;
+                }
+            }
+            PC--;
+            cycles++;
+            result.reason = opcode == (Byte)opcodes::INS_BRK ? halt_reasons::BRK : halt_reasons::ILLEGAL_OPCODE;
+            result.address = PC;
+            return false;
+        }
+
+        /**
+         * @brief the loop of exec, Checked adds the breakpoint and watchpoint checks
+         * 
+         * A breakpoint halts before its instruction runs; the next exec starting at the same PC runs it.
+         * A watchpoint halts after the instruction accessing its address has run.
+         * 
+         * Stepped presents the cycles of each instruction to the bus devices, and returns early once
+         * none of them is active anymore.
+         */
+        template<bool Checked, bool Stepped>
+        EXEC_RESULT run(s32 cycles, MEM& memory)
+        {
+            const s32 CyclesRequested = cycles;
+            EXEC_RESULT Result{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+            u32 Instructions = 0;
+            fused_retired = 0;
+            s32 SkipBreakpoint = -1;    // PC of the breakpoint to run through, none once the PC moved
+            if constexpr (Checked)
+            {
+                if (resume_from_breakpoint)
+                    SkipBreakpoint = PC;
+                resume_from_breakpoint = false;
+            }
+            while (cycles > interrupt_deadline || take_interrupt(cycles, memory))
+            {
+                MEMORY_ACCESS Accesses[3];
+                u32 AccessCount = 0;
+                BUS_CYCLE Trace[BUS_MAX_CYCLES];
+                u32 TraceLength = 0;
+                s32 CyclesBefore = cycles;
+                if constexpr (Checked)
+                {
+                    if (breakpoints->execute[PC] && PC != SkipBreakpoint)
+                    {
+                        resume_from_breakpoint = true;
+                        Result.reason = halt_reasons::BREAKPOINT;
+                        Result.address = PC;
+                        break;
+                    }
+                    SkipBreakpoint = -1;
+                }
+                if constexpr (Checked || Stepped)
+                {
+                    const INSTRUCTION_INFO* Info = instruction_info(memory[PC]);
+                    if (!Info && illegal_opcode_policy == illegal_opcode_policies::UNDOCUMENTED)
+                        Info = undocumented_instruction_info(memory[PC]);
+                    if (Checked && Info)
+                        AccessCount = memory_accesses(*this, memory, *Info, Accesses);
+                    if (Stepped)
+                        TraceLength = bus_cycles(*this, memory, Info, Trace);
+                }
+
+                // Fused handlers would run several instructions between checks
+                auto& Handlers = Checked || Stepped ? instructions : dispatch;
+                Byte Instruction = fetch_byte(cycles, memory);
+                auto Handler = Handlers.find((opcodes)Instruction);
+                if (Handler != Handlers.end())
+                    Handler->second(this, cycles, &memory);
+                else if (!exec_unhandled(Instruction, cycles, memory, Result))
+                    break;
+                Instructions++;
+
+                if constexpr (Stepped)
+                    bus->present(Trace, TraceLength, memory, CyclesBefore - cycles);
+
+                if constexpr (Checked)
+                {
+                    bool Hit = false;
+                    for (u32 i = 0; i < AccessCount && !Hit; i++)
+                    {
+                        Hit = Accesses[i].write ? breakpoints->write[Accesses[i].address] : breakpoints->read[Accesses[i].address];
+                        if (Hit)
+                        {
+                            Result.reason = halt_reasons::WATCHPOINT;
+                            Result.address = Accesses[i].address;
+                        }
+                    }
+                    if (Hit)
+                        break;
+                }
+                if (Stepped && !bus->stepping())
+                    break;
+            }
+            Result.cycles = CyclesRequested - cycles;
+            Result.instructions = Instructions + fused_retired;
+            return Result;
         }
 
         void reset(Word ResetVector, MEM& memory)
     	{
-    		PC = ResetVector;
-    		SP = 0x0100;
-    		C = Z = I = D = B = V = N = 0;
-    		A = X = Y = 0;
+            reset_registers(ResetVector);
             set_instructions();
     		memory.initialize();
     	}
@@ -99,12 +348,115 @@ namespace EM6502
             return LoByte | (HiByte << 8);
         }
 
+        /** Reads a pointer from the zero page, its high byte at $FF wraps to $00 */
+        Word read_zero_page_word(s32& cycles, MEM& memory, Byte address)
+        {
+            Byte LoByte = read_byte(cycles, memory, address);
+            Byte HiByte = read_byte(cycles, memory, (Byte)(address + 1));
+            return LoByte | (HiByte << 8);
+        }
+
+        /** Address of the next free byte of the stack */
+        Word stack_address() const
+        {
+            return 0x0100 | SP;
+        }
+
+        void push_byte(s32& cycles, MEM& memory, Byte data)
+        {
+            memory.Data[0x0100 | SP] = data;
+            SP--;
+            cycles--;
+        }
+
+        Byte pull_byte(s32& cycles, MEM& memory)
+        {
+            SP++;
+            cycles--;
+            return memory.Data[0x0100 | SP];
+        }
+
+        /** Pushes the high byte first, so that the word is little endian on the stack */
+        void push_word(s32& cycles, MEM& memory, Word data)
+        {
+            push_byte(cycles, memory, data >> 8);
+            push_byte(cycles, memory, data & 0xFF);
+        }
+
+        Word pull_word(s32& cycles, MEM& memory)
+        {
+            Byte LoByte = pull_byte(cycles, memory);
+            Byte HiByte = pull_byte(cycles, memory);
+            return LoByte | (HiByte << 8);
+        }
+
+        /** Status flags packed as NV-BDIZC */
+        Byte status() const
+        {
+            return C | (Z << 1) | (I << 2) | (D << 3) | (B << 4) | (1 << 5) | (V << 6) | (N << 7);
+        }
+
+        void set_status(Byte flags)
+        {
+            C = flags;
+            Z = flags >> 1;
+            I = flags >> 2;
+            D = flags >> 3;
+            B = flags >> 4;
+            V = flags >> 6;
+            N = flags >> 7;
+            update_interrupt_deadline();
+        }
+
+        REGISTERS registers() const
+        {
+            return { PC, SP, A, X, Y, status() };
+        }
+
+        void set_registers(const REGISTERS& registers)
+        {
+            PC = registers.PC;
+            SP = registers.SP;
+            A = registers.A;
+            X = registers.X;
+            Y = registers.Y;
+            set_status(registers.P);
+        }
+
+        INTERRUPT_LINES interrupt_lines() const
+        {
+            return { irq_lines, nmi_line, nmi_pending };
+        }
+
+        /** Restores the lines, call after set_registers() so the deadline follows the restored I */
+        void set_interrupt_lines(const INTERRUPT_LINES& lines)
+        {
+            irq_lines = lines.irq_lines;
+            nmi_line = lines.nmi_line;
+            nmi_pending = lines.nmi_pending;
+            update_interrupt_deadline();
+        }
+
         inline void ld_set_status(Register& reg)
         {
             Z = (reg == 0);
             N = (reg & 0b10000000) > 0;
         }
 
+        /** Resets PC, SP and the registers like reset() but keeps the memory and the handlers */
+        void reset_registers(Word ResetVector = 0xFFFC)
+        {
+            PC = ResetVector;
+            SP = 0xFD;     // A reset runs 3 pushes with the writes disabled
+            C = Z = D = B = V = N = 0;
+            I = 1;
+            A = X = Y = 0;
+            call_depth = 0;
+            irq_lines = 0;
+            nmi_line = nmi_pending = false;
+            update_interrupt_deadline();
+        }
+
         /**
          * @brief resets the cpu's PC, SP and registers and also initializes the memory
          * 
@@ -121,23 +473,135 @@ namespace EM6502
          * @param cycles: number of cycles the program takes to execute e.g. LDA Immediate uses 2 cycles
          * @param memory: MEM object containing the program instructions and data to be executed
          * 
-         * @return the number of cycles that were used */
-        s32 exec(s32 cycles, MEM& memory)
+         * @return the number of cycles and instructions that were used and why execution stopped */
+        EXEC_RESULT exec(s32 cycles, MEM& memory)
         {
-            const s32 CyclesRequested = cycles;
-            while(cycles > 0)
+            bool Checked = breakpoints && breakpoints->armed();
+            if (!Checked)
+                resume_from_breakpoint = false;
+            if (!bus)
+                return Checked ? run<true, false>(cycles, memory) : run<false, false>(cycles, memory);
+
+            // Steps while a device is active, otherwise runs the instruction level loop until the next wake
+            EXEC_RESULT Result{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+            while (Result.cycles < cycles)
             {
-                Byte Instruction = fetch_byte(cycles, memory);
-                if (instructions.count((opcodes)Instruction))
-                    instructions[(opcodes)Instruction](this, cycles, &memory);
-                else 
+                bus->wake();
+                s32 Remaining = cycles - Result.cycles;
+                EXEC_RESULT Slice;
+                if (bus->stepping())
+                    Slice = Checked ? run<true, true>(Remaining, memory) : run<false, true>(Remaining, memory);
+                else
                 {
-                    printf("Unhandled instruction: %02X\n", Instruction);
-                    throw -1;
+                    u64 Wake = bus->next_wake();
+                    if (Wake - bus->cycle < (u64)Remaining)
+                        Remaining = Wake - bus->cycle;
+                    Slice = Checked ? run<true, false>(Remaining, memory) : run<false, false>(Remaining, memory);
+                    bus->cycle += Slice.cycles;
                 }
+                Result.cycles += Slice.cycles;
+                Result.instructions += Slice.instructions;
+                Result.reason = Slice.reason;
+                Result.address = Slice.address;
+                if (Slice.reason != halt_reasons::BUDGET_EXHAUSTED || Slice.cycles == 0)
+                    break;
             }
-            const s32 NumCyclesUsed = CyclesRequested - cycles;
-            return NumCyclesUsed;
+            return Result;
+        }
+
+        /** Makes the next exec run the instruction at PC even if it has a breakpoint */
+        void skip_breakpoint()
+        {
+            resume_from_breakpoint = true;
+        }
+
+        /**
+         * @brief executes like exec() without fused handlers, counting the opcode pairs and triples that run
+         * 
+         * @param profile: FUSION_PROFILE object the counts are added to
+         * 
+         * @return the number of cycles and instructions that were used and why execution stopped */
+        EXEC_RESULT exec_profiled(s32 cycles, MEM& memory, FUSION_PROFILE& profile);
+
+        /**
+         * @brief replaces the handlers of the leading opcodes of the most frequent sequences in a
+         * profile with fused handlers, the cycles used by exec() stay the same
+         * 
+         * @param profile: FUSION_PROFILE object collected with exec_profiled()
+         * @param max_fused: maximum number of opcodes whose handler gets replaced
+         * 
+         * @return the number of fused handlers selected */
+        u32 select_fused(const FUSION_PROFILE& profile, u32 max_fused);
+
+        /** Restores the unfused handler of every opcode */
+        void clear_fused()
+        {
+            dispatch = instructions;
+        }
+
+        /** Holds or releases the IRQ line for a source, an interrupt is taken while any holds it and I is clear */
+        void set_irq(bool asserted, u32 source = 1)
+        {
+            irq_lines = asserted ? irq_lines | source : irq_lines & ~source;
+            update_interrupt_deadline();
+        }
+
+        /** Sets the level of the NMI line, an interrupt is taken once each time it rises */
+        void set_nmi(bool asserted)
+        {
+            if (asserted && !nmi_line)
+                nmi_pending = true;
+            nmi_line = asserted;
+            update_interrupt_deadline();
+        }
+
+        /** Must follow any change of I or of the interrupt lines */
+        void update_interrupt_deadline()
+        {
+            interrupt_deadline = nmi_pending || (irq_lines && !I) ? 0x7FFFFFFF : 0;
+        }
+
+        /**
+         * @brief pushes PC and the status flags, sets I and jumps through the vector, the tail of the
+         * interrupt sequence shared with BRK
+         * 
+         * @param brk: sets B in the pushed flags
+         */
+        void interrupt(s32& cycles, MEM& memory, Word vector, bool brk)
+        {
+            Word ReturnAddr = PC;
+            push_word(cycles, memory, ReturnAddr);
+            push_byte(cycles, memory, (status() & ~0x10) | (brk ? 0x10 : 0));
+            I = 1;
+            PC = read_word(cycles, memory, vector);
+            push_call(PC, ReturnAddr - 1);
+            update_interrupt_deadline();
+        }
+
+        /**
+         * @brief takes a pending interrupt at an instruction boundary with its 7 cycles entry sequence, NMI first
+         * 
+         * Only called once cycles <= interrupt_deadline, i.e. when the budget is used or an interrupt is pending.
+         * 
+         * @return true if there are cycles left to run the handler
+         */
+        bool take_interrupt(s32& cycles, MEM& memory)
+        {
+            if (cycles <= 0)
+                return false;
+            Word Vector = nmi_pending ? NMI_VECTOR : IRQ_VECTOR;
+            nmi_pending = false;
+            BUS_CYCLE Trace[BUS_MAX_CYCLES];
+            u32 TraceLength = 0;
+            s32 CyclesBefore = cycles;
+            bool Stepped = bus && bus->stepping();
+            if (Stepped)
+                TraceLength = interrupt_cycles(*this, memory, Vector, Trace);
+            cycles -= 2;    // The opcode at PC is read twice and discarded
+            interrupt(cycles, memory, Vector, false);
+            if (Stepped)
+                bus->present(Trace, TraceLength, memory, CyclesBefore - cycles);
+            return cycles > 0;
         }
 
         void load_register(s32& cycles, MEM& memory, Word address, Register& reg)
@@ -0,0 +1,39 @@
+#ifndef EM6502_FUSION_H_
+#define EM6502_FUSION_H_
+
+#include "utils.h"
+#include <map>
+#include <stdio.h>
+
+namespace EM6502
+{
+    /**
+     * @brief counts of the opcode pairs and triples executed, used to pick fused handlers
+     *
+     * Sequences are keyed by their opcodes packed as first | second << 8 | third << 16.
+     */
+    struct FUSION_PROFILE
+    {
+        std::map<u32, u32> pairs;
+        std::map<u32, u32> triples;
+
+        void clear()
+        {
+            pairs.clear();
+            triples.clear();
+        }
+
+        /**
+         * @brief saves the profile as text, one "pair|triple <hex sequence> <count>" line per entry
+         */
+        void write(FILE* file) const;
+
+        /**
+         * @brief adds the counts of a profile written by write()
+         *
+         * @return false if the file is malformed
+         */
+        bool read(FILE* file);
+    };
+}
+#endif // EM6502_FUSION_H_
\ No newline at end of file
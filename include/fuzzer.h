@@ -0,0 +1,100 @@
+#ifndef EM6502_FUZZER_H_
+#define EM6502_FUZZER_H_
+
+#include "cpu.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    /** Ways of executing code that must give the same results as the interpreter */
+    enum class engines : Byte
+    {
+        INTERPRETER,    // CPU::exec with the base handlers
+        FUSED,          // CPU::exec with fused handlers selected at random
+        CHECKED,        // CPU::exec with breakpoints and watchpoints armed, resumed after each hit
+        STEPPED         // CPU::exec stepping the bus for a device that sleeps at random
+    };
+
+    const char* engine_name(engines engine);
+
+    /** @return false if the name is not an engine */
+    bool parse_engine(const char* name, engines& engine);
+
+    /** Initial state and program of a fuzzing case, small enough to be rebuilt for each run */
+    struct FUZZ_CASE
+    {
+        u64 seed;                                   // The memory is filled with random bytes from it
+        REGISTERS registers;                        // PC is the first instruction of the program
+        std::vector<std::vector<Byte>> program;     // One entry per instruction, a BRK follows the last one
+        s32 cycles;
+        bool undocumented;                          // Runs with illegal_opcode_policies::UNDOCUMENTED
+
+        /**
+         * @brief makes a random case of implemented opcodes with random operands
+         *
+         * @param seed: the case is a function of it only
+         * @param length: number of instructions
+         */
+        static FUZZ_CASE random(u64 seed, u32 length, bool undocumented);
+
+        /** Sets the registers and fills the memory, then writes the program */
+        void build(CPU& cpu, MEM& memory) const;
+
+        /** Registers, memory seed and listing of the program */
+        std::string describe() const;
+    };
+
+    /** CPU and memory running one engine, reused between cases */
+    struct FUZZ_MACHINE
+    {
+        engines engine;
+        CPU cpu;
+        std::unique_ptr<MEM> memory;
+        BREAKPOINTS breakpoints;
+        BUS bus;
+        BUS_DEVICE device;
+        u64 next_cycle;         // Cycle the device expects next, UINT64_MAX after a sleep
+        u32 bus_gaps;           // Cycles the device saw out of sequence during the last run
+        u64 random_state;       // Reseeded from each case, so a case runs the same way on any worker
+        u64 shuffle_seed;       // Seed of the fused handlers selected
+
+        FUZZ_MACHINE(engines engine, u64 seed);
+        FUZZ_MACHINE(const FUZZ_MACHINE&) = delete;
+        FUZZ_MACHINE& operator=(const FUZZ_MACHINE&) = delete;
+
+        /**
+         * @brief builds the case then runs it, resuming after breakpoints with engines::CHECKED and
+         * checking with engines::STEPPED that the bus cycles follow the timing of the instructions
+         */
+        EXEC_RESULT run(const FUZZ_CASE& fuzz_case);
+
+        /** Selects a random set of fused handlers with engines::FUSED, a function of the seed only */
+        void shuffle(u64 seed);
+    };
+
+    /**
+     * @brief finds the first byte that differs between two memories, comparing 64 bytes per step with SSE2
+     * and 8 otherwise
+     *
+     * @return the address, or -1 if they are equal
+     */
+    s32 first_difference(const MEM& a, const MEM& b);
+
+    /**
+     * @brief runs a case on two machines and compares the results, registers, flags and memory
+     *
+     * @param differences: receives a description of what differs, may be nullptr
+     *
+     * @return true if anything differs
+     */
+    bool run_differs(FUZZ_MACHINE& a, FUZZ_MACHINE& b, const FUZZ_CASE& fuzz_case, std::string* differences);
+
+    /** Removes instructions from a differing case as long as it keeps differing */
+    FUZZ_CASE minimize(FUZZ_MACHINE& a, FUZZ_MACHINE& b, FUZZ_CASE fuzz_case);
+
+    /** "fuzz" command of the emulator */
+    int fuzz_command(int argc, char** argv);
+}
+#endif // EM6502_FUZZER_H_
\ No newline at end of file
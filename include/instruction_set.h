@@ -3,6 +3,8 @@
 
 #include "utils.h"
 #include <map>
+#include <span>
+#include <vector>
 
 namespace EM6502
 {
@@ -30,13 +32,139 @@ namespace EM6502
         INS_LDY_ZPX = 0xB4,
         INS_LDY_ABS = 0xAC,
         INS_LDY_ABSX = 0xBC,
-        INS_JSR = 0x20
+        INS_JSR = 0x20,
+        INS_RTS = 0x60,
+        INS_RTI = 0x40,
+        INS_PHA = 0x48,
+        INS_PLA = 0x68,
+        INS_PHP = 0x08,
+        INS_PLP = 0x28,
+        INS_TXS = 0x9A,
+        INS_TSX = 0xBA,
+        INS_CLI = 0x58,
+        INS_SEI = 0x78,
+        INS_BRK = 0x00
     };
 
+  // Undocumented NMOS opcodes, only run with illegal_opcode_policies::UNDOCUMENTED
+  enum class undocumented_opcodes : Byte
+    {
+        INS_LAX_ZP = 0xA7,
+        INS_LAX_ZPY = 0xB7,
+        INS_LAX_ABS = 0xAF,
+        INS_LAX_ABSY = 0xBF,
+        INS_LAX_INDX = 0xA3,
+        INS_LAX_INDY = 0xB3,
+        INS_SAX_ZP = 0x87,
+        INS_SAX_ZPY = 0x97,
+        INS_SAX_ABS = 0x8F,
+        INS_SAX_INDX = 0x83
+        // The many NOP variants are listed in the table of undocumented_instruction_table()
+    };
+
+  enum class addressing_modes : Byte
+    {
+        IMP,    // Implied
+        IM,     // Immediate
+        ZP,     // Zero Page
+        ZPX,    // Zero Page,X
+        ZPY,    // Zero Page,Y
+        ABS,    // Absolute
+        ABSX,   // Absolute,X
+        ABSY,   // Absolute,Y
+        INDX,   // (Indirect,X)
+        INDY    // (Indirect),Y
+    };
+
+  enum class flow_types : Byte
+    {
+        NEXT,   // Execution continues with the following instruction
+        CALL,   // Absolute subroutine call
+        RETURN, // Continues at an address pulled from the stack
+        BREAK   // BRK, halts unless CPU::halt_on_brk is cleared
+    };
+
+  enum class access_types : Byte
+    {
+        NONE,       // Only the instruction bytes are read
+        READ,       // Reads the effective address
+        WRITE,      // Writes the effective address
+        PUSH_BYTE,  // Writes 1 byte on the stack
+        PUSH_WORD,  // Writes 2 bytes on the stack
+        PUSH_WORD_STATUS,   // Writes a word then the status flags on the stack
+        PULL_BYTE,  // Reads 1 byte from the stack
+        PULL_WORD,  // Reads 2 bytes from the stack
+        PULL_STATUS_WORD    // Reads the status flags then a word from the stack
+    };
+
+  /** Decoding and timing data of an implemented opcode */
+  struct INSTRUCTION_INFO
+    {
+        const char* name;       // Name of the handler e.g. "LDA_ABSX"
+        addressing_modes mode;
+        flow_types flow;
+        Byte cycles;            // Cycles used when no page boundary is crossed
+        bool page_penalty;      // Takes 1 more cycle when the indexed address crosses a page
+        access_types access;    // Data memory accessed
+    };
+
+  /**
+   * @brief looks up the decoding and timing data of an opcode
+   * 
+   * @return nullptr if the opcode is not implemented
+   */
+  const INSTRUCTION_INFO* instruction_info(Byte opcode);
+
+  /**
+   * @brief looks up the decoding and timing data of an undocumented NMOS opcode
+   * 
+   * @return nullptr if the opcode is not emulated
+   */
+  const INSTRUCTION_INFO* undocumented_instruction_info(Byte opcode);
+
+  /** Number of bytes taken by an instruction using the addressing mode, opcode included */
+  Byte instruction_size(addressing_modes mode);
+
   typedef void(*INSTRUCTION)(CPU*, s32&, MEM*);
 
 #define INSTRUCTION_PARAMS CPU*, s32&, MEM*
 
+  /**
+   * @brief handler executing a sequence of adjacent instructions in a single dispatch
+   * 
+   * The handler replaces the one of the leading opcode. Each following instruction only runs if
+   * there are cycles left and its opcode is the one actually found at PC, so the registers, memory
+   * and cycle count are always the same as with unfused execution.
+   */
+  struct FUSED_INSTRUCTION
+    {
+        Byte sequence[3];   // Opcodes in execution order
+        Byte length;        // Number of opcodes used in sequence
+        INSTRUCTION handler;
+    };
+
+  /** Every fused handler that can be selected: all pairs of opcodes and a few common triples */
+  const std::vector<FUSED_INSTRUCTION>& fused_instructions();
+
+  /** Row of the opcode tables: the handler running an opcode and its decoding data */
+  struct INSTRUCTION_ENTRY
+    {
+        Byte opcode;
+        INSTRUCTION handler;
+        INSTRUCTION_INFO info;
+    };
+
+  /**
+   * @brief the documented opcodes run by a handler, the only list of them: CPU::set_instructions,
+   * instruction_info() and the fused handlers are built from it
+   * 
+   * BRK isn't in it, as it is run by CPU::exec_unhandled.
+   */
+  std::span<const INSTRUCTION_ENTRY> instruction_table();
+
+  /** Same for the undocumented opcodes emulated under illegal_opcode_policies::UNDOCUMENTED */
+  std::span<const INSTRUCTION_ENTRY> undocumented_instruction_table();
+
   // NOP
   void NOP(INSTRUCTION_PARAMS);
   // LDA
@@ -60,8 +188,36 @@ namespace EM6502
   void LDY_ZPX(INSTRUCTION_PARAMS);
   void LDY_ABS(INSTRUCTION_PARAMS);
   void LDY_ABSX(INSTRUCTION_PARAMS);
-  // JSR
+  // Stack
   void JSR(INSTRUCTION_PARAMS);
+  void RTS(INSTRUCTION_PARAMS);
+  void RTI(INSTRUCTION_PARAMS);
+  void PHA(INSTRUCTION_PARAMS);
+  void PLA(INSTRUCTION_PARAMS);
+  void PHP(INSTRUCTION_PARAMS);
+  void PLP(INSTRUCTION_PARAMS);
+  void TXS(INSTRUCTION_PARAMS);
+  void TSX(INSTRUCTION_PARAMS);
+  // Interrupts
+  void BRK(INSTRUCTION_PARAMS);
+  void CLI(INSTRUCTION_PARAMS);
+  void SEI(INSTRUCTION_PARAMS);
+  // Undocumented
+  void LAX_ZP(INSTRUCTION_PARAMS);
+  void LAX_ZPY(INSTRUCTION_PARAMS);
+  void LAX_ABS(INSTRUCTION_PARAMS);
+  void LAX_ABSY(INSTRUCTION_PARAMS);
+  void LAX_INDX(INSTRUCTION_PARAMS);
+  void LAX_INDY(INSTRUCTION_PARAMS);
+  void SAX_ZP(INSTRUCTION_PARAMS);
+  void SAX_ZPY(INSTRUCTION_PARAMS);
+  void SAX_ABS(INSTRUCTION_PARAMS);
+  void SAX_INDX(INSTRUCTION_PARAMS);
+  void NOP_IM(INSTRUCTION_PARAMS);
+  void NOP_ZP(INSTRUCTION_PARAMS);
+  void NOP_ZPX(INSTRUCTION_PARAMS);
+  void NOP_ABS(INSTRUCTION_PARAMS);
+  void NOP_ABSX(INSTRUCTION_PARAMS);
 }
 
 #endif // EM6502_INSTRUCTION_SET_H_
\ No newline at end of file
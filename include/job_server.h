@@ -0,0 +1,48 @@
+#ifndef EM6502_JOB_SERVER_H_
+#define EM6502_JOB_SERVER_H_
+
+#include "batch.h"
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    /** Bytes written over the pristine image before a job runs */
+    struct MEMORY_PATCH
+    {
+        Word address;
+        std::vector<Byte> data;
+    };
+
+    /**
+     * @brief job sent to the server as one text line of key=value fields, e.g.
+     * "entry=$0200 cycles=10000 instructions=500 patch=$0300:a98400 return=pc,a,x"
+     *
+     * entry is required. The limits default to those of BATCH_JOB, patches are applied in order and
+     * return lists the registers of the reply among pc, sp, a, x, y and p (all of them by default).
+     */
+    struct JOB_REQUEST
+    {
+        BATCH_JOB job;
+        std::vector<MEMORY_PATCH> patches;
+        Byte returned = 0x3F;   // One bit per register, in the order of the return field names
+    };
+
+    /** @return false if the line is malformed */
+    bool parse_request(const char* line, JOB_REQUEST& request);
+
+    /**
+     * @brief runs a request on a warm machine: the pristine image is copied back over the memory and the
+     * registers are reset, which costs a 64 KiB copy instead of a reset and reloading the ROMs
+     *
+     * @return the reply line, a JSON object without the trailing newline
+     */
+    std::string run_request(const JOB_REQUEST& request, const MEM& pristine, CPU& cpu, MEM& memory);
+
+    /** "serve" command of the emulator */
+    int serve_command(int argc, char** argv);
+
+    /** "loadgen" command of the emulator, measures a server against spawning the emulator per job */
+    int loadgen_command(int argc, char** argv);
+}
+#endif // EM6502_JOB_SERVER_H_
\ No newline at end of file
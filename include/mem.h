@@ -3,6 +3,7 @@
 
 #include "utils.h"
 #include <assert.h>
+#include <stdio.h>
 
 namespace EM6502
 {
@@ -21,10 +22,23 @@ namespace EM6502
         }
 
         /**
-         * @brief loads a program into the object
+         * @brief loads a program image from a file into the object
          * 
+         * @param path: file containing the raw program bytes
+         * @param address: address the first byte is loaded at
+         * 
+         * @return the number of bytes loaded, 0 if the file can't be read or doesn't fit
          */
-        // void load_program(); UNUSED
+        u32 load_program(const char* path, Word address)
+        {
+            FILE* file = fopen(path, "rb");
+            if (!file)
+                return 0;
+            u32 size = fread(Data + address, 1, MAX_MEM - address, file);
+            bool fits = fgetc(file) == EOF;
+            fclose(file);
+            return fits ? size : 0;
+        }
 
         /** Read 1 byte */
         Byte operator[](u32 address) const
@@ -40,6 +54,13 @@ namespace EM6502
             return Data[address]; 
         } 
 
+        /** Write 1 byte */
+        void write_byte(s32& cycles, Byte data, u32 address)
+        {
+            Data[address] = data;
+            cycles--;
+        }
+
         /** Write 2 bytes */
         void write_word(s32& cycles, Word data, u32 address)
         {
@@ -0,0 +1,56 @@
+#ifndef EM6502_PACER_H_
+#define EM6502_PACER_H_
+
+#include "cpu.h"
+#include <chrono>
+#include <stdio.h>
+
+namespace EM6502
+{
+    /**
+     * @brief runs a CPU at a target clock rate instead of as fast as possible
+     *
+     * Execution goes in slices of slice_cycles. After each slice the pacer sleeps until shortly before the
+     * wall time the slice should end at, then spins on the monotonic clock for the rest, so the host CPU
+     * stays mostly idle while wake ups stay precise. The spin lasts spin_fraction of a slice, at most
+     * max_spin. A slice that ends late is not slept after, so the emulated clock catches up and keeps the
+     * long term rate, unless it fell more than max_lag behind (e.g. the process was stopped) in which case
+     * the schedule restarts from now.
+     */
+    struct PACER
+    {
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr u32 JITTER_BUCKETS = 20;
+
+        double frequency;                           // Emulated cycles per second e.g. 1022727 for an Apple II
+        s32 slice_cycles = 1000;
+        double spin_fraction = 0.05;                // 50 us of a 1 ms slice, about the timer slack of a sleep
+        Clock::duration max_spin = std::chrono::microseconds(200);
+        Clock::duration max_lag = std::chrono::milliseconds(100);
+
+        // Statistics of the last run
+        u64 slices = 0;
+        u64 late_slices = 0;                        // Slices that ended after their deadline
+        u64 resyncs = 0;                            // Times the schedule was restarted after max_lag
+        double max_drift_us = 0;                    // Largest distance between wall and emulated time
+        double final_drift_us = 0;
+        u64 jitter[JITTER_BUCKETS] = {};            // Wake up lateness, bucket i counts < 2^i microseconds
+
+        explicit PACER(double frequency) : frequency(frequency) {}
+
+        /**
+         * @brief executes paced until the cycles are used or the CPU halts
+         *
+         * @return the halt reason of the last CPU::exec call, with cycles and instructions summed over the run
+         */
+        RUN_RESULT run(CPU& cpu, MEM& memory, u64 cycles);
+
+        /** Prints the drift and the jitter histogram */
+        void report(FILE* out) const;
+    };
+
+    /** "pace" command of the emulator */
+    int pace_command(int argc, char** argv);
+}
+#endif // EM6502_PACER_H_
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef EM6502_PERF_COUNTERS_H_
+#define EM6502_PERF_COUNTERS_H_
+
+#include "utils.h"
+
+namespace EM6502
+{
+    enum class perf_events : Byte
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        ITLB_MISSES,
+        COUNT
+    };
+
+    /**
+     * @brief host hardware counters of the calling thread, read with Linux perf_event_open
+     *
+     * Each counter is opened on its own so the ones the host or container refuses are simply
+     * unavailable. Values are scaled when the kernel had to multiplex the counters.
+     */
+    struct PERF_COUNTERS
+    {
+        PERF_COUNTERS();
+        ~PERF_COUNTERS();
+        PERF_COUNTERS(const PERF_COUNTERS&) = delete;
+        PERF_COUNTERS& operator=(const PERF_COUNTERS&) = delete;
+
+        /**
+         * @brief opens the counters
+         *
+         * @return false if none is available, error() then tells why
+         */
+        bool open();
+
+        void start();
+        void stop();
+
+        bool available(perf_events event) const
+        {
+            return fds[(u32)event] >= 0;
+        }
+
+        /** Count between the last start() and stop() */
+        u64 value(perf_events event) const
+        {
+            return values[(u32)event];
+        }
+
+        const char* error() const
+        {
+            return last_error;
+        }
+
+        static const char* name(perf_events event);
+
+    private:
+        int fds[(u32)perf_events::COUNT];
+        u64 values[(u32)perf_events::COUNT];
+        const char* last_error = "not opened";
+    };
+}
+#endif // EM6502_PERF_COUNTERS_H_
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef EM6502_PROFILER_H_
+#define EM6502_PROFILER_H_
+
+#include "cpu.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    /** Routine names by address, loaded from label files */
+    struct SYMBOLS
+    {
+        std::map<Word, std::string> labels;
+
+        /**
+         * @brief adds the labels of a VICE label file ("al C:8000 .main", as written by ld65 -Ln)
+         * or of a ca65/ld65 debug file (ld65 --dbgfile), the format is detected from the content
+         *
+         * Cheap local labels (@name) are skipped so their code counts for the enclosing routine.
+         *
+         * @return false if the file can't be read
+         */
+        bool load(const char* path);
+
+        /**
+         * @brief finds the routine containing an address: the closest label at or below it
+         *
+         * @return the address of the label, or -1 if there is none
+         */
+        s32 routine(Word address) const;
+
+        /** Label of a routine returned by routine(), or its address as $XXXX if it has none */
+        std::string name(s32 routine) const;
+    };
+
+    /**
+     * @brief statistical profiler sampling the emulated PC and JSR call stack every interval cycles
+     *
+     * Each sample weighs interval cycles. A routine gets them as self cycles when PC is in it, and as
+     * inclusive cycles when it is anywhere on the call stack. The overhead is one CPU::exec call plus
+     * a few map lookups per sample, so longer intervals make it negligible.
+     */
+    struct PROFILER
+    {
+        const SYMBOLS& symbols;
+        s32 interval;
+
+        u64 samples = 0;
+        double sampling_seconds = 0;    // Time spent taking samples
+        std::map<s32, u64> self;
+        std::map<s32, u64> inclusive;
+        std::map<std::vector<s32>, u64> stacks;   // Outermost routine first
+
+        PROFILER(const SYMBOLS& symbols, s32 interval) : symbols(symbols), interval(interval) {}
+
+        /**
+         * @brief executes while sampling until the cycles are used or the CPU halts
+         *
+         * @return the halt reason of the last CPU::exec call, with cycles and instructions summed over the run
+         */
+        RUN_RESULT run(CPU& cpu, MEM& memory, u64 cycles);
+
+        void sample(const CPU& cpu, u64 cycles);
+
+        /** Prints the routines by self cycles */
+        void report(FILE* out) const;
+
+        /** Writes one "outer;inner;leaf cycles" line per stack, the input of flamegraph.pl */
+        void write_folded(FILE* out) const;
+    };
+
+    /** "profile" command of the emulator */
+    int profile_command(int argc, char** argv);
+}
+#endif // EM6502_PROFILER_H_
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef EM6502_RECOMPILER_H_
+#define EM6502_RECOMPILER_H_
+
+#include "cpu.h"
+#include <map>
+#include <vector>
+
+namespace EM6502
+{
+    /**
+     * @brief translates a fixed ROM image ahead of time into C++ source
+     *
+     * Code is traced from the entry points with the same decoding rules as CPU::exec. Every traced
+     * instruction becomes a case of a switch on PC that calls the instruction handler directly, so
+     * cycle counts are exact and a run can stop and resume on any instruction. Anything the tracer
+     * can't prove (code outside the ROM, which may be modified, or unknown opcodes) is left to the
+     * interpreter, and so is a traced instruction whose opcode was overwritten at run time: each case
+     * checks its opcode byte first.
+     *
+     * The generated code includes cpu.h, whose inline exec() also needs memory_accesses() and the bus, so it
+     * links with src/instruction_set.cpp, src/breakpoints.cpp and src/bus.cpp.
+     */
+    struct RECOMPILER
+    {
+        Word rom_start;
+        u32 rom_size;
+        std::vector<Word> entries;
+        std::map<Word, const INSTRUCTION_INFO*> code;   // Traced instructions by address
+
+        /**
+         * @brief follows every path reachable from the entry points inside the ROM
+         *
+         * @param memory: MEM object the ROM image is loaded into
+         */
+        void trace(const MEM& memory);
+
+        /**
+         * @brief writes the traced code as a C++ function
+         *
+         * @param out: file the source is written to
+         * @param memory: MEM object the ROM image is loaded into
+         * @param name: name of the generated function, it has the signature EXEC_RESULT(CPU&, MEM&, s32 cycles)
+         * @param with_main: also emit the ROM bytes and a main() running the first entry point
+         */
+        void emit(FILE* out, const MEM& memory, const char* name, bool with_main) const;
+
+    private:
+        bool in_rom(Word address) const
+        {
+            return address >= rom_start && (u32)(address - rom_start) < rom_size;
+        }
+    };
+
+    /** "recompile" command of the emulator */
+    int recompile_command(int argc, char** argv);
+}
+#endif // EM6502_RECOMPILER_H_
\ No newline at end of file
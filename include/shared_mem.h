@@ -0,0 +1,111 @@
+#ifndef EM6502_SHARED_MEM_H_
+#define EM6502_SHARED_MEM_H_
+
+#include "cpu.h"
+#include <atomic>
+#include <string.h>
+
+namespace EM6502
+{
+    /** Start of a shared segment, the live MEM object and the published image follow it */
+    struct SHARED_HEADER
+    {
+        u32 magic;
+        u32 version;
+        std::atomic<u32> sequence;  // Odd while the emulator is publishing
+        REGISTERS registers;
+        u64 cycles;                 // Cycles executed when the state was published
+    };
+
+    /**
+     * @brief a MEM object backed by a POSIX shared memory segment, for monitoring from other processes
+     *
+     * Monitors map the segment read-only. They can poll the live memory without any copy, which may be
+     * caught mid-instruction, or take a consistent snapshot of the state published by the emulator.
+     * publish() copies the registers and memory into the segment under a seqlock: monitors retry when
+     * the sequence was odd or changed during their copy, so the emulator never waits for them and only
+     * pays for a 64 KiB copy per publication.
+     *
+     * Only available on POSIX systems, create() and open() fail elsewhere.
+     */
+    struct SHARED_MEM
+    {
+        static constexpr u32 MAGIC = 0x32303536;   // "6502"
+        static constexpr u32 VERSION = 1;
+        static constexpr size_t MEMORY_OFFSET = 4096;
+        static constexpr size_t PUBLISHED_OFFSET = MEMORY_OFFSET + sizeof(MEM);
+        static constexpr size_t SIZE = PUBLISHED_OFFSET + MAX_MEM;
+
+        SHARED_MEM() = default;
+        SHARED_MEM(const SHARED_MEM&) = delete;
+        SHARED_MEM& operator=(const SHARED_MEM&) = delete;
+        ~SHARED_MEM()
+        {
+            close();
+        }
+
+        /**
+         * @brief creates the segment for writing, replacing any segment with the same name
+         *
+         * @param name: POSIX shared memory name e.g. "/em6502"
+         */
+        bool create(const char* name);
+
+        /** Maps an existing segment read-only */
+        bool open(const char* name);
+
+        /** Unmaps the segment, and removes it if it was created by this object */
+        void close();
+
+        /** MEM object the emulator runs on, only writable after create() */
+        MEM& memory()
+        {
+            return *(MEM*)(base + MEMORY_OFFSET);
+        }
+
+        const MEM& memory() const
+        {
+            return *(const MEM*)(base + MEMORY_OFFSET);
+        }
+
+        /** Makes the current state available to snapshot(), call it between CPU::exec calls */
+        void publish(const CPU& cpu, u64 cycles)
+        {
+            SHARED_HEADER& Header = header();
+            u32 Sequence = Header.sequence.load(std::memory_order_relaxed);
+            Header.sequence.store(Sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Header.registers = cpu.registers();
+            Header.cycles = cycles;
+            memcpy(base + PUBLISHED_OFFSET, base + MEMORY_OFFSET, MAX_MEM);
+            Header.sequence.store(Sequence + 2, std::memory_order_release);
+        }
+
+        /**
+         * @brief copies the last published state
+         *
+         * @param image: receives the 64 KiB of memory, may be nullptr to only read the registers
+         * @param max_attempts: attempts before giving up while the emulator keeps publishing
+         *
+         * @return false if no consistent copy could be made
+         */
+        bool snapshot(REGISTERS& registers, u64& cycles, Byte* image, u32 max_attempts = 1000000) const;
+
+    private:
+        Byte* base = nullptr;
+        char name[256] = {};
+        bool owner = false;
+
+        SHARED_HEADER& header() const
+        {
+            return *(SHARED_HEADER*)base;
+        }
+    };
+
+    /** "share" command of the emulator, runs a program in shared memory */
+    int share_command(int argc, char** argv);
+
+    /** "monitor" command of the emulator, prints a snapshot of a shared emulator */
+    int monitor_command(int argc, char** argv);
+}
+#endif // EM6502_SHARED_MEM_H_
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef EM6502_TEST_MATRIX_H_
+#define EM6502_TEST_MATRIX_H_
+
+#include "cpu.h"
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    /** Registers an operation writes its operand to */
+    enum class matrix_targets : Byte
+    {
+        NONE = 0,
+        A = 1,
+        X = 2,
+        Y = 4,
+        AX = 3
+    };
+
+    /** Row of the compact spec, expanded to every addressing mode of the mnemonic */
+    struct MATRIX_OPERATION
+    {
+        const char* mnemonic;       // Prefix of the handler names, e.g. "LDA" covers LDA_IM to LDA_INDY
+        matrix_targets loads;       // Registers receiving the operand, which also set Z and N
+        bool stores_ax;             // Writes A & X to the operand address instead, flags untouched
+    };
+
+    /** One generated case: an instruction, its addressing edge case and the state it starts from */
+    struct MATRIX_CASE
+    {
+        Byte opcode;
+        const INSTRUCTION_INFO* info;
+        const MATRIX_OPERATION* operation;
+        bool undocumented;          // Runs with illegal_opcode_policies::UNDOCUMENTED
+        Word operand;               // Byte or word following the opcode
+        Word pointer;               // Address stored in the zero page by the indirect modes
+        Byte value;                 // Operand of loads, A of stores
+        REGISTERS registers;
+
+        /** Instruction, operand and starting registers */
+        std::string describe() const;
+    };
+
+    /**
+     * @brief CPU and memory reused by every case: only the registers and the bytes written by the
+     * previous case are reset, instead of copying a whole MEM per test
+     */
+    struct TEST_FIXTURE
+    {
+        CPU& cpu;
+        MEM& memory;
+        std::vector<Word> written;
+
+        TEST_FIXTURE(CPU& cpu, MEM& memory) : cpu(cpu), memory(memory) {}
+
+        /** Writes a byte to be cleared by the next reset() */
+        void poke(Word address, Byte value)
+        {
+            memory[address] = value;
+            written.push_back(address);
+        }
+
+        void reset()
+        {
+            for (Word Address : written)
+                memory[Address] = 0;
+            written.clear();
+            cpu.reset_registers();
+        }
+    };
+
+    /**
+     * @brief expands the spec into operations × addressing modes × edge cases: zero, positive and
+     * negative operands, zero page indexes and pointers wrapping at $FF, page crossings and flags
+     * that start set or cleared
+     */
+    std::vector<MATRIX_CASE> generate_matrix();
+
+    /**
+     * @brief runs one case on the fixture and checks the registers, flags, memory and cycles against
+     * the address arithmetic of a 6502
+     *
+     * @param failure: receives what differs, may be nullptr
+     *
+     * @return true if the case passed
+     */
+    bool run_matrix_case(TEST_FIXTURE& fixture, const MATRIX_CASE& test_case, std::string* failure);
+
+    /**
+     * @brief runs the whole matrix, printing the failed cases and a summary
+     *
+     * @return the number of failed cases
+     */
+    u32 run_test_matrix(CPU& cpu, MEM& memory, FILE* out);
+}
+#endif // EM6502_TEST_MATRIX_H_
\ No newline at end of file
@@ -0,0 +1,121 @@
+#ifndef EM6502_TIMELINE_H_
+#define EM6502_TIMELINE_H_
+
+#include "cpu.h"
+#include <array>
+#include <deque>
+#include <vector>
+
+namespace EM6502
+{
+    /**
+     * @brief runs a CPU while keeping periodic checkpoints, so execution can be moved backwards
+     *
+     * A checkpoint is taken at the first instruction boundary after every interval cycles. It holds the
+     * registers and the memory pages that changed since the previous checkpoint; every keyframe_every-th
+     * checkpoint holds a full memory image instead. Going back restores the nearest checkpoint before the
+     * target and re-executes forward, which is deterministic as the CPU only depends on its registers, its
+     * interrupt lines and memory. The shadow call stack is restored too, so predicted_return() and the
+     * profiler's stacks follow the history that was moved to. Lines changed by the caller between checkpoints
+     * aren't recorded: seeking before such a change replays with the lines saved by the checkpoint.
+     *
+     * Memory/latency tradeoff: a keyframe costs 64 KiB and a delta 256 bytes per changed page. A seek copies
+     * one keyframe, applies at most keyframe_every - 1 deltas and re-executes at most interval cycles
+     * (plus the length of one instruction), so its latency is about interval / emulated cycles per second.
+     * Halving the interval halves the seek time and doubles the number of checkpoints. When the memory
+     * budget is exceeded, the oldest keyframe and its deltas are dropped, limiting how far back one can go.
+     *
+     * Breakpoints are ignored while re-executing, other than by reverse_continue().
+     */
+    struct TIMELINE
+    {
+        TIMELINE(CPU& cpu, MEM& memory, u64 interval, u32 keyframe_every, size_t memory_budget);
+
+        /**
+         * @brief executes forward, taking checkpoints on the way
+         *
+         * Checkpoints after the current cycle, left by going backwards, are discarded first.
+         *
+         * @return the result of the last CPU::exec call, with cycles and instructions summed over the run
+         */
+        EXEC_RESULT run(s32 cycles);
+
+        /**
+         * @brief moves to the first instruction boundary at or after a cycle
+         *
+         * @return false if the cycle is before the oldest checkpoint kept
+         */
+        bool seek(u64 cycle);
+
+        /**
+         * @brief moves to the start of the previous instruction
+         *
+         * @return false if there is no earlier instruction kept
+         */
+        bool reverse_step();
+
+        /**
+         * @brief moves back to the last time an armed execution breakpoint was reached
+         *
+         * @return false if no breakpoint was reached since the oldest checkpoint kept
+         */
+        bool reverse_continue();
+
+        /** Cycles executed since the timeline started */
+        u64 cycle() const
+        {
+            return now;
+        }
+
+        size_t memory_used() const
+        {
+            return used;
+        }
+
+        size_t checkpoint_count() const
+        {
+            return checkpoints.size();
+        }
+
+    private:
+        using PAGE = std::array<Byte, 256>;
+
+        struct CHECKPOINT
+        {
+            u64 cycle;
+            REGISTERS registers;
+            INTERRUPT_LINES interrupts;     // Held IRQ lines and a pending NMI replay the same way
+            u32 call_depth;
+            std::vector<CALL_FRAME> calls;  // Tracked frames of the shadow call stack, outermost first
+            bool keyframe;
+            std::vector<Byte> image;                        // Full memory, keyframes only
+            std::vector<std::pair<Byte, PAGE>> pages;       // Pages changed since the previous checkpoint
+        };
+
+        CPU& cpu;
+        MEM& memory;
+        u64 interval;
+        u32 keyframe_every;
+        size_t memory_budget;
+
+        u64 now = 0;
+        size_t used = 0;
+        u32 since_keyframe = 0;
+        std::deque<CHECKPOINT> checkpoints;
+        std::vector<Byte> last_image;       // Memory at the last checkpoint
+
+        void checkpoint();
+        size_t checkpoint_size(const CHECKPOINT& checkpoint) const;
+
+        /** Rebuilds the memory image of a checkpoint */
+        void reconstruct(size_t index, Byte* image) const;
+
+        /** Restores the last checkpoint at or before a cycle, returns false if there is none */
+        bool restore(u64 cycle);
+        void restore_index(size_t index);
+
+        /** Executes at least the given cycles without breakpoints */
+        EXEC_RESULT replay(u64 cycles);
+    };
+}
+#endif // EM6502_TIMELINE_H_
\ No newline at end of file
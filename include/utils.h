@@ -1,6 +1,8 @@
 #ifndef EM6502_UTILS_H_
 #define EM6502_UTILS_H_
 
+#include <stdlib.h>
+
 namespace EM6502
 {
     using Byte = unsigned char;
@@ -9,7 +11,22 @@ namespace EM6502
 
     using u32 = unsigned int;
     using s32 = signed int;
+    using u64 = unsigned long long;
 
     static constexpr u32 MAX_MEM = 1024 * 64;
+
+    /**
+     * @brief parses a number given on the command line, hex may be written as 0x1234 or $1234
+     * 
+     * @return false if the text is not a number
+     */
+    inline bool parse_number(const char* text, u32& value)
+    {
+        if (!text || !*text)
+            return false;
+        char* end;
+        value = (text[0] == '$') ? strtoul(text + 1, &end, 16) : strtoul(text, &end, 0);
+        return *end == '\0';
+    }
 }
 #endif // EM6502_UTILS_H
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef EM6502_WCET_H_
+#define EM6502_WCET_H_
+
+#include "cpu.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace EM6502
+{
+    /** Fewest and most cycles of the paths reaching one kind of exit */
+    struct CYCLE_BOUNDS
+    {
+        bool reachable = false;
+        u64 best = 0;
+        u64 worst = 0;
+
+        /** Adds the paths of other to this set of paths */
+        void merge(const CYCLE_BOUNDS& other);
+    };
+
+    /** Straight line code entered at start only */
+    struct BASIC_BLOCK
+    {
+        Word start;
+        Word end;                   // Address after the last instruction
+        u32 best = 0;               // Cycles of its instructions, JSR included but not the subroutine
+        u32 worst = 0;              // Same with every possible page crossing penalty
+        std::vector<Word> successors;
+        s32 call = -1;              // Subroutine called by the last instruction
+        bool halts = false;         // Ends on BRK or an opcode the interpreter halts on
+        bool returns = false;       // Ends on RTS or RTI
+    };
+
+    /** Static bounds of a routine, from its entry to the end of every path */
+    struct ROUTINE_BOUNDS
+    {
+        CYCLE_BOUNDS to_halt;       // Paths ending in a halt (BRK or an unhandled opcode), which takes no cycle
+        CYCLE_BOUNDS to_return;     // Paths returning to the caller
+        std::string problem;        // Why the routine can't be bounded, empty if it is
+
+        bool bounded() const
+        {
+            return problem.empty();
+        }
+    };
+
+    /**
+     * @brief estimates the best and worst case cycles of code in a ROM without running it
+     *
+     * Instructions are decoded with instruction_info(), the table the interpreter's timing follows, and
+     * the control flow graph of each routine is built from basic blocks. Absolute indexed loads can only
+     * cross a page when the low byte of their base address isn't 0; other page crossing penalties are
+     * always counted in the worst case.
+     *
+     * A cycle in the graph is a loop and needs a bound: the most times its header runs each time the loop
+     * is entered. The worst case adds the longest trip around the loop for each extra iteration, inner
+     * loops first, so nested loops compose. The best case runs each loop once. A routine is unbounded if
+     * a loop has no bound, it calls itself or its code leaves the ROM.
+     */
+    struct WCET_ESTIMATOR
+    {
+        const MEM& memory;
+        Word rom_start;
+        u32 rom_size;
+        bool undocumented = false;      // Decodes the opcodes of illegal_opcode_policies::UNDOCUMENTED
+        std::map<Word, u32> loop_bounds;                // Loop header -> most iterations
+        std::map<Word, ROUTINE_BOUNDS> routines;
+
+        WCET_ESTIMATOR(const MEM& memory, Word rom_start, u32 rom_size) : memory(memory), rom_start(rom_start), rom_size(rom_size) {}
+
+        /**
+         * @brief reads loop bounds, one "<header address> <iterations>" per line, # starts a comment
+         *
+         * @return false if a line is malformed
+         */
+        bool read_bounds(FILE* file);
+
+        /** Bounds of the routine at the entry address and of the subroutines it calls */
+        const ROUTINE_BOUNDS& analyze(Word entry);
+
+        /** Prints the bounds of every analyzed routine */
+        void report(FILE* out) const;
+
+    private:
+        std::set<Word> analyzing;   // Routines on the analysis stack, to detect recursion
+
+        bool in_rom(Word address) const
+        {
+            return address >= rom_start && (u32)(address - rom_start) < rom_size;
+        }
+
+        const INSTRUCTION_INFO* decode(Word address) const;
+
+        /** Best and worst cycles of the instruction, page crossing included */
+        void instruction_cycles(Word address, const INSTRUCTION_INFO& info, u32& best, u32& worst) const;
+
+        /** Finds the blocks of a routine by their start, or tells why it can't */
+        bool build_blocks(Word entry, std::map<Word, BASIC_BLOCK>& blocks, std::string& problem) const;
+    };
+
+    /** "wcet" command of the emulator */
+    int wcet_command(int argc, char** argv);
+}
+#endif // EM6502_WCET_H_
\ No newline at end of file
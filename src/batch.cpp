@@ -0,0 +1,328 @@
+#include "../include/batch.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string.h>
+
+namespace EM6502
+{
+  using Clock = std::chrono::steady_clock;
+
+  static const char* expectation_name(expectation_targets target)
+  {
+    switch (target)
+    {
+      case expectation_targets::REASON: return "reason";
+      case expectation_targets::PC: return "pc";
+      case expectation_targets::A: return "a";
+      case expectation_targets::X: return "x";
+      case expectation_targets::Y: return "y";
+      case expectation_targets::MEMORY: return "memory";
+      default: return "?";
+    }
+  }
+
+  bool parse_job(const char* line, BATCH_JOB& job)
+  {
+    std::vector<std::string> Tokens;
+    const char* Position = line;
+    while (*Position && *Position != '#')
+    {
+      size_t Length = strcspn(Position, " \t\r\n#");
+      if (Length)
+        Tokens.emplace_back(Position, Length);
+      Position += Length;
+      Position += strspn(Position, " \t\r\n");
+    }
+
+    u32 LoadAddress, Entry;
+    if (Tokens.size() < 3 || !parse_number(Tokens[1].c_str(), LoadAddress) || LoadAddress >= MAX_MEM ||
+        !parse_number(Tokens[2].c_str(), Entry) || Entry >= MAX_MEM)
+      return false;
+    job.program = Tokens[0];
+    job.load_address = LoadAddress;
+    job.entry = Entry;
+
+    for (size_t i = 3; i < Tokens.size(); i++)
+    {
+      size_t Separator = Tokens[i].find('=');
+      if (Separator == std::string::npos)
+        return false;
+      std::string Key = Tokens[i].substr(0, Separator);
+      const char* Value = Tokens[i].c_str() + Separator + 1;
+      u32 Number = 0;
+      bool IsNumber = parse_number(Value, Number);
+      u32 Address;
+
+      if (Key == "reason")
+        job.expectations.push_back({ expectation_targets::REASON, 0, 0, Value });
+      else if (!IsNumber)
+        return false;
+      else if (Key == "cycles" && Number > 0)
+        job.max_cycles = Number;
+      else if (Key == "instructions")
+        job.max_instructions = Number;
+      else if (Key == "pc" && Number < MAX_MEM)
+        job.expectations.push_back({ expectation_targets::PC, 0, Number, "" });
+      else if ((Key == "a" || Key == "x" || Key == "y") && Number <= 0xFF)
+      {
+        expectation_targets Target = Key == "a" ? expectation_targets::A : Key == "x" ? expectation_targets::X : expectation_targets::Y;
+        job.expectations.push_back({ Target, 0, Number, "" });
+      }
+      else if (parse_number(Key.c_str(), Address) && Address < MAX_MEM && Number <= 0xFF)
+        job.expectations.push_back({ expectation_targets::MEMORY, (Word)Address, Number, "" });
+      else
+        return false;
+    }
+    return true;
+  }
+
+  BATCH_RESULT execute_job(const BATCH_JOB& job, CPU& cpu, MEM& memory)
+  {
+    BATCH_RESULT Result;
+    Result.loaded = true;
+    Result.reason = halt_reason_name(halt_reasons::BUDGET_EXHAUSTED);
+    while (Result.cycles < job.max_cycles)
+    {
+      u64 Budget = std::min<u64>(job.max_cycles - Result.cycles, 0x7FFFFFFF);
+      if (job.max_instructions)
+      {
+        if (Result.instructions >= job.max_instructions)
+        {
+          Result.reason = "instruction_limit";
+          break;
+        }
+        Budget = std::min<u64>(Budget, 2 * (job.max_instructions - Result.instructions));
+      }
+      EXEC_RESULT Exec = cpu.exec((s32)Budget, memory);
+      Result.cycles += Exec.cycles;
+      Result.instructions += Exec.instructions;
+      if (Exec.reason != halt_reasons::BUDGET_EXHAUSTED)
+      {
+        Result.reason = halt_reason_name(Exec.reason);
+        break;
+      }
+    }
+
+    for (const EXPECTATION& Expectation : job.expectations)
+    {
+      bool Met = false;
+      switch (Expectation.target)
+      {
+        case expectation_targets::REASON: Met = Expectation.reason == Result.reason; break;
+        case expectation_targets::PC: Met = cpu.PC == Expectation.value; break;
+        case expectation_targets::A: Met = cpu.A == Expectation.value; break;
+        case expectation_targets::X: Met = cpu.X == Expectation.value; break;
+        case expectation_targets::Y: Met = cpu.Y == Expectation.value; break;
+        case expectation_targets::MEMORY: Met = memory[Expectation.address] == Expectation.value; break;
+      }
+      if (!Met)
+        Result.failed.push_back(expectation_name(Expectation.target));
+    }
+    return Result;
+  }
+
+  BATCH_RESULT run_job(const BATCH_JOB& job, CPU& cpu, MEM& memory)
+  {
+    auto Start = Clock::now();
+    cpu.reset_registers();
+    memory.initialize();
+    BATCH_RESULT Result;
+    if (memory.load_program(job.program.c_str(), job.load_address))
+    {
+      cpu.PC = job.entry;
+      Result = execute_job(job, cpu, memory);
+    }
+    Result.wall_us = std::chrono::duration<double, std::micro>(Clock::now() - Start).count();
+    return Result;
+  }
+
+  static void append_json_string(std::string& out, const std::string& text)
+  {
+    out += '"';
+    for (char Character : text)
+    {
+      if (Character == '"' || Character == '\\')
+      {
+        out += '\\';
+        out += Character;
+      }
+      else if ((unsigned char)Character < 0x20)
+      {
+        char Escaped[8];
+        snprintf(Escaped, sizeof(Escaped), "\\u%04x", Character);
+        out += Escaped;
+      }
+      else
+        out += Character;
+    }
+    out += '"';
+  }
+
+  /** One JSON object per line so results can be streamed and processed as they arrive */
+  static std::string result_json(u32 index, const BATCH_JOB& job, const BATCH_RESULT& result, const CPU& cpu)
+  {
+    std::string Line = "{\"job\":" + std::to_string(index) + ",\"program\":";
+    append_json_string(Line, job.program);
+    if (!result.loaded)
+      return Line + ",\"status\":\"error\",\"error\":\"can't load the program\"}";
+
+    char Fields[256];
+    snprintf(Fields, sizeof(Fields),
+             ",\"status\":\"%s\",\"reason\":\"%s\",\"cycles\":%llu,\"instructions\":%llu,\"pc\":%u,\"a\":%u,\"x\":%u,\"y\":%u,\"wall_us\":%.1f",
+             result.failed.empty() ? "pass" : "fail", result.reason, result.cycles, result.instructions, cpu.PC, cpu.A,
+             cpu.X, cpu.Y, result.wall_us);
+    Line += Fields;
+    if (!result.failed.empty())
+    {
+      Line += ",\"failed\":[";
+      for (size_t i = 0; i < result.failed.size(); i++)
+        Line += std::string(i ? ",\"" : "\"") + result.failed[i] + "\"";
+      Line += "]";
+    }
+    return Line + "}";
+  }
+
+  static bool read_manifest(const char* path, const BATCH_JOB& defaults, std::vector<BATCH_JOB>& jobs)
+  {
+    FILE* File = fopen(path, "r");
+    if (!File)
+    {
+      fprintf(stderr, "can't read %s\n", path);
+      return false;
+    }
+    // Programs are relative to the manifest
+    std::filesystem::path Directory = std::filesystem::path(path).parent_path();
+    char Line[4096];
+    u32 LineNumber = 0;
+    bool Valid = true;
+    while (Valid && fgets(Line, sizeof(Line), File))
+    {
+      LineNumber++;
+      if (Line[strspn(Line, " \t\r\n")] == '\0' || Line[strspn(Line, " \t")] == '#')
+        continue;
+      BATCH_JOB Job = defaults;
+      Valid = parse_job(Line, Job);
+      if (!Valid)
+      {
+        fprintf(stderr, "%s:%u: malformed job\n", path, LineNumber);
+        break;
+      }
+      if (std::filesystem::path(Job.program).is_relative())
+        Job.program = (Directory / Job.program).string();
+      jobs.push_back(Job);
+    }
+    fclose(File);
+    return Valid;
+  }
+
+  static bool read_directory(const char* path, const BATCH_JOB& defaults, std::vector<BATCH_JOB>& jobs)
+  {
+    std::error_code Error;
+    std::vector<std::string> Programs;
+    for (auto it = std::filesystem::directory_iterator(path, Error); !Error && it != std::filesystem::directory_iterator();
+         it.increment(Error))
+    {
+      if (it->is_regular_file(Error))
+        Programs.push_back(it->path().string());
+    }
+    if (Error)
+    {
+      fprintf(stderr, "can't list %s: %s\n", path, Error.message().c_str());
+      return false;
+    }
+    std::sort(Programs.begin(), Programs.end());
+    for (const std::string& Program : Programs)
+    {
+      jobs.push_back(defaults);
+      jobs.back().program = Program;
+    }
+    return true;
+  }
+
+  int run_command(int argc, char** argv)
+  {
+    BATCH_JOB Defaults;
+    u32 Workers = std::max(1u, std::thread::hardware_concurrency());
+    u32 Number;
+    bool EntryGiven = false;
+    bool Valid = argc >= 1;
+    for (int i = 1; Valid && i < argc; i++)
+    {
+      Valid = i + 1 < argc && parse_number(argv[i + 1], Number);
+      if (!Valid)
+        break;
+      if (strcmp(argv[i], "--jobs") == 0 && Number > 0)
+        Workers = Number;
+      else if (strcmp(argv[i], "--cycles") == 0 && Number > 0)
+        Defaults.max_cycles = Number;
+      else if (strcmp(argv[i], "--instructions") == 0)
+        Defaults.max_instructions = Number;
+      else if (strcmp(argv[i], "--load") == 0 && Number < MAX_MEM)
+        Defaults.load_address = Number;
+      else if (strcmp(argv[i], "--entry") == 0 && Number < MAX_MEM)
+      {
+        Defaults.entry = Number;
+        EntryGiven = true;
+      }
+      else
+        Valid = false;
+      i++;
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator run <manifest|directory> [--jobs workers] [--cycles limit] [--instructions limit]"
+                      " [--load address] [--entry address]\n"
+                      "manifest lines: <program> <load> <entry> [cycles=N] [instructions=N] [reason=name] [pc=N] [a=N]"
+                      " [x=N] [y=N] [<address>=N]\n");
+      return 1;
+    }
+    if (!EntryGiven)
+      Defaults.entry = Defaults.load_address;
+
+    std::vector<BATCH_JOB> Jobs;
+    std::error_code Error;
+    bool Read = std::filesystem::is_directory(argv[0], Error) ? read_directory(argv[0], Defaults, Jobs)
+                                                              : read_manifest(argv[0], Defaults, Jobs);
+    if (!Read)
+      return 1;
+    Workers = std::min<u32>(Workers, std::max<size_t>(1, Jobs.size()));
+
+    std::atomic<u32> Next{ 0 };
+    std::atomic<u32> Passed{ 0 }, Failed{ 0 }, Errors{ 0 };
+    std::mutex Output;
+    auto Worker = [&]()
+    {
+      // One machine per worker, reset between jobs
+      std::unique_ptr<MEM> Memory(new MEM);
+      CPU cpu;
+      cpu.reset(*Memory);
+      for (u32 Index; (Index = Next++) < Jobs.size();)
+      {
+        BATCH_RESULT Result = run_job(Jobs[Index], cpu, *Memory);
+        std::string Line = result_json(Index, Jobs[Index], Result, cpu);
+        (!Result.loaded ? Errors : Result.failed.empty() ? Passed : Failed)++;
+        std::lock_guard<std::mutex> Lock(Output);
+        fprintf(stdout, "%s\n", Line.c_str());
+        fflush(stdout);
+      }
+    };
+
+    auto Start = Clock::now();
+    std::vector<std::thread> Threads;
+    for (u32 i = 1; i < Workers; i++)
+      Threads.emplace_back(Worker);
+    Worker();
+    for (std::thread& Thread : Threads)
+      Thread.join();
+    double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+
+    fprintf(stderr, "%zu jobs on %u workers in %.3f s: %u passed, %u failed, %u errors\n", Jobs.size(), Workers, Seconds,
+            Passed.load(), Failed.load(), Errors.load());
+    return Failed || Errors ? 1 : 0;
+  }
+}
\ No newline at end of file
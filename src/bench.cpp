@@ -0,0 +1,271 @@
+#include "../include/bench.h"
+#include "../include/fusion.h"
+#include "../include/timeline.h"
+#include "../include/perf_counters.h"
+#include <chrono>
+#include <string.h>
+
+namespace EM6502
+{
+  using Clock = std::chrono::steady_clock;
+
+  static double seconds_since(Clock::time_point start)
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  void load_bench_workload(MEM& memory, bool writes)
+  {
+    // 8 bytes so the block repeats exactly over the 64 KiB
+    const Byte Block[] = {
+      (Byte)opcodes::INS_LDA_ZP, 0x10,
+      (Byte)opcodes::INS_LDX_IM, 0x05,
+      (Byte)opcodes::INS_LDY_ABSX, 0x34, 0x12,
+      (Byte)opcodes::INS_NOP
+    };
+    // The stores only change operands, so the code stays valid
+    const Byte WriteBlock[] = {
+      (Byte)opcodes::INS_LDA_ZP, 0x10,
+      (Byte)undocumented_opcodes::INS_SAX_ZP, 0x31,
+      (Byte)opcodes::INS_LDY_ABSX, 0x34, 0x12,
+      (Byte)opcodes::INS_NOP
+    };
+    for (u32 Address = 0; Address < MAX_MEM; Address += 8)
+      memcpy(memory.Data + Address, writes ? WriteBlock : Block, 8);
+  }
+
+  static void print_counters(const PERF_COUNTERS* counters, const EXEC_RESULT& result, u32 dispatches)
+  {
+    if (!counters)
+      return;
+    for (u32 i = 0; i < (u32)perf_events::COUNT; i++)
+    {
+      perf_events Event = (perf_events)i;
+      if (counters->available(Event))
+        printf("    %-18s %14llu\n", PERF_COUNTERS::name(Event), counters->value(Event));
+      else
+        printf("    %-18s %14s\n", PERF_COUNTERS::name(Event), "unavailable");
+    }
+    if (counters->available(perf_events::INSTRUCTIONS))
+      printf("    host instructions per emulated instruction %8.2f\n",
+             (double)counters->value(perf_events::INSTRUCTIONS) / result.instructions);
+    if (counters->available(perf_events::BRANCH_MISSES))
+      printf("    branch misses per dispatch                 %8.4f\n",
+             (double)counters->value(perf_events::BRANCH_MISSES) / dispatches);
+  }
+
+  static void bench_interpreter(CPU& cpu, MEM& memory, s32 cycles, bool fused, PERF_COUNTERS* counters)
+  {
+    cpu.reset(memory);
+    load_bench_workload(memory, false);
+    if (fused)
+    {
+      FUSION_PROFILE Profile;
+      cpu.exec_profiled(100000, memory, Profile);
+      cpu.select_fused(Profile, 16);
+    }
+
+    if (counters)
+      counters->start();
+    auto Start = Clock::now();
+    EXEC_RESULT Result = cpu.exec(cycles, memory);
+    double Seconds = seconds_since(Start);
+    if (counters)
+      counters->stop();
+
+    printf("%-12s %10d cycles %10u instructions %8.3f s %8.2f MIPS\n", fused ? "fused" : "interpreter",
+           Result.cycles, Result.instructions, Seconds, Result.instructions / Seconds / 1e6);
+    print_counters(counters, Result, Result.instructions - cpu.fused_retired);
+    cpu.clear_fused();
+  }
+
+  /** Timer of bench_interrupts, a bus device sleeping between its events */
+  struct BENCH_TIMER
+  {
+    CPU* cpu;
+    BUS_DEVICE device;
+    u64 period;
+    bool raise;             // Holds IRQ for IRQ_PULSE cycles at each expiry, otherwise only wakes
+    u64 expiry;             // Cycle of the current or next expiry
+    bool holding = false;   // The next wake ends the pulse
+    u64 raised = 0;
+  };
+
+  static constexpr u64 IRQ_PULSE = 12;    // Until the entry is over, released before the handler returns
+
+  static void timer_tick(void* context, u64, const BUS_CYCLE&)
+  {
+    BENCH_TIMER& Timer = *(BENCH_TIMER*)context;
+    if (!Timer.device.active)
+      return;     // Rest of the instruction the timer woke on
+    Timer.device.active = false;
+    Timer.holding = !Timer.holding;
+    if (Timer.holding)
+    {
+      Timer.device.wake_cycle = Timer.expiry + IRQ_PULSE;
+      Timer.raised += Timer.raise;
+    }
+    else
+    {
+      Timer.expiry += Timer.period;
+      Timer.device.wake_cycle = Timer.expiry;
+    }
+    if (Timer.raise)
+      Timer.cpu->set_irq(Timer.holding);
+  }
+
+  static void bench_interrupts(CPU& cpu, MEM& memory, s32 cycles)
+  {
+    // There are no jumps: the workload wraps around the memory and also runs through the handler, after
+    // pushing the frame its RTI pulls. The vector at $FFFE is skipped as the operand of LDY_ABSX, then
+    // its high byte, $EA, runs as a NOP.
+    constexpr Word HANDLER = 0xEA07;
+    const Byte Handler[] = {
+      (Byte)opcodes::INS_LDA_IM, 0xEA,
+      (Byte)opcodes::INS_PHA,
+      (Byte)opcodes::INS_LDA_IM, 0x10,
+      (Byte)opcodes::INS_PHA,
+      (Byte)opcodes::INS_PHP,
+      (Byte)opcodes::INS_PHA,             // $EA07, saves A, which the jumps may be using
+      (Byte)opcodes::INS_LDA_ZP, 0x10,    // Reads the timer
+      (Byte)opcodes::INS_LDX_IM, 0x05,
+      (Byte)opcodes::INS_PLA,
+      (Byte)opcodes::INS_NOP,
+      (Byte)opcodes::INS_RTI              // Continues at $EA10, the next block
+    };
+    // Same jump over the top of the stack page, to $0200
+    const Byte SkipStack[] = {
+      (Byte)opcodes::INS_LDA_IM, 0x02,
+      (Byte)opcodes::INS_PHA,
+      (Byte)opcodes::INS_LDA_IM, 0x00,
+      (Byte)opcodes::INS_PHA,
+      (Byte)opcodes::INS_PHP,
+      (Byte)opcodes::INS_RTI
+    };
+
+    for (s32 Period : { 0, 10000, 1000, 100 })
+      for (bool Raise : { false, true })
+      {
+        if (!Period && Raise)
+          continue;
+        cpu.reset(memory);
+        load_bench_workload(memory, false);
+        memcpy(memory.Data + HANDLER - 7, Handler, sizeof(Handler));
+        memcpy(memory.Data + 0x01E0, SkipStack, sizeof(SkipStack));
+        memory[CPU::IRQ_VECTOR] = HANDLER & 0xFF;
+        memory[CPU::IRQ_VECTOR + 1] = HANDLER >> 8;
+        cpu.set_status(cpu.status() & ~0x04);
+
+        // The quiet timer wakes exactly like the raising one, so both runs are sliced the same way
+        BUS Bus;
+        BENCH_TIMER Timer{ &cpu, { timer_tick, &Timer, false, (u64)Period }, (u64)Period, Raise, (u64)Period };
+        if (Period)
+        {
+          Bus.attach(Timer.device);
+          cpu.bus = &Bus;
+        }
+        auto Start = Clock::now();
+        EXEC_RESULT Result = cpu.exec(cycles, memory);
+        double Seconds = seconds_since(Start);
+        cpu.bus = nullptr;
+
+        char Label[24];
+        snprintf(Label, sizeof(Label), Period ? "%s %d" : "none", Raise ? "irq every" : "quiet", Period);
+        printf("interrupts   %-16s %10d cycles %10u instructions %8.3f s %8.2f MIPS %8.2f MHz %8llu taken\n", Label,
+               Result.cycles, Result.instructions, Seconds, Result.instructions / Seconds / 1e6, Result.cycles / Seconds / 1e6,
+               Timer.raised);
+      }
+  }
+
+  static void bench_timeline(CPU& cpu, MEM& memory, s32 cycles)
+  {
+    for (u64 Interval : { 10000ull, 100000ull, 1000000ull })
+    {
+      cpu.reset(memory);
+      cpu.illegal_opcode_policy = illegal_opcode_policies::UNDOCUMENTED;
+      load_bench_workload(memory, true);
+
+      TIMELINE Timeline(cpu, memory, Interval, 16, 64 * 1024 * 1024);
+      auto Start = Clock::now();
+      Timeline.run(cycles);
+      double RunSeconds = seconds_since(Start);
+
+      constexpr u32 SEEKS = 100;
+      u64 Seed = 12345;
+      Start = Clock::now();
+      for (u32 i = 0; i < SEEKS; i++)
+      {
+        Seed = Seed * 6364136223846793005ull + 1442695040888963407ull;
+        Timeline.seek((Seed >> 16) % (u64)cycles);
+      }
+      double SeekSeconds = seconds_since(Start) / SEEKS;
+
+      printf("timeline     interval %8llu: %6zu checkpoints %8.2f MiB run %8.3f s seek %10.1f us\n", Interval,
+             Timeline.checkpoint_count(), Timeline.memory_used() / (1024.0 * 1024.0), RunSeconds, SeekSeconds * 1e6);
+    }
+    cpu.illegal_opcode_policy = illegal_opcode_policies::HALT;
+  }
+
+  int bench_command(int argc, char** argv)
+  {
+    bool Perf = false;
+    const char* Arguments[2] = { "all", nullptr };
+    int Count = 0;
+    for (int i = 0; i < argc; i++)
+    {
+      if (strcmp(argv[i], "--perf") == 0)
+        Perf = true;
+      else if (Count < 2)
+        Arguments[Count++] = argv[i];
+    }
+
+    const char* Workload = Arguments[0];
+    u32 Cycles = 100000000;
+    if (Arguments[1] && (!parse_number(Arguments[1], Cycles) || Cycles == 0 || Cycles > 0x7FFFFFFF))
+    {
+      fprintf(stderr, "usage: emulator bench [all|interpreter|fused|timeline|interrupts] [cycles] [--perf]\n");
+      return 1;
+    }
+
+    PERF_COUNTERS Counters;
+    PERF_COUNTERS* UsedCounters = nullptr;
+    if (Perf)
+    {
+      if (Counters.open())
+        UsedCounters = &Counters;
+      else
+        printf("perf counters unavailable: %s\n", Counters.error());
+    }
+
+    static MEM memory;
+    CPU cpu;
+    bool All = strcmp(Workload, "all") == 0;
+    bool Known = All;
+    if (All || strcmp(Workload, "interpreter") == 0)
+    {
+      bench_interpreter(cpu, memory, Cycles, false, UsedCounters);
+      Known = true;
+    }
+    if (All || strcmp(Workload, "fused") == 0)
+    {
+      bench_interpreter(cpu, memory, Cycles, true, UsedCounters);
+      Known = true;
+    }
+    if (All || strcmp(Workload, "timeline") == 0)
+    {
+      bench_timeline(cpu, memory, Cycles);
+      Known = true;
+    }
+    if (All || strcmp(Workload, "interrupts") == 0)
+    {
+      bench_interrupts(cpu, memory, Cycles);
+      Known = true;
+    }
+    if (!Known)
+    {
+      fprintf(stderr, "unknown workload: %s\n", Workload);
+      return 1;
+    }
+    return 0;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "../include/breakpoints.h"
+#include "../include/cpu.h"
+
+namespace EM6502
+{
+  u32 memory_accesses(const CPU& cpu, const MEM& memory, const INSTRUCTION_INFO& info, MEMORY_ACCESS accesses[3])
+  {
+    if (info.access == access_types::NONE)
+      return 0;
+
+    // The stack wraps within page one
+    switch (info.access)
+    {
+      case access_types::PUSH_BYTE:
+        accesses[0] = { cpu.stack_address(), true };
+        return 1;
+      case access_types::PUSH_WORD:
+      case access_types::PUSH_WORD_STATUS:
+      {
+        u32 Count = info.access == access_types::PUSH_WORD ? 2 : 3;
+        for (u32 i = 0; i < Count; i++)
+          accesses[i] = { (Word)(0x0100 | (Byte)(cpu.SP - i)), true };
+        return Count;
+      }
+      case access_types::PULL_BYTE:
+      case access_types::PULL_WORD:
+      case access_types::PULL_STATUS_WORD:
+      {
+        u32 Count = info.access == access_types::PULL_BYTE ? 1 : info.access == access_types::PULL_WORD ? 2 : 3;
+        for (u32 i = 0; i < Count; i++)
+          accesses[i] = { (Word)(0x0100 | (Byte)(cpu.SP + 1 + i)), false };
+        return Count;
+      }
+      default:
+        break;
+    }
+
+    // Same address arithmetic as the handlers
+    Byte Operand = memory[(Word)(cpu.PC + 1)];
+    Word AbsAddr = Operand | (memory[(Word)(cpu.PC + 2)] << 8);
+    u32 Count = 0;
+    Word Address;
+    switch (info.mode)
+    {
+      case addressing_modes::ZP:
+        Address = Operand;
+        break;
+      case addressing_modes::ZPX:
+        Address = (Byte)(Operand + cpu.X);
+        break;
+      case addressing_modes::ZPY:
+        Address = (Byte)(Operand + cpu.Y);
+        break;
+      case addressing_modes::ABS:
+        Address = AbsAddr;
+        break;
+      case addressing_modes::ABSX:
+        Address = AbsAddr + cpu.X;
+        break;
+      case addressing_modes::ABSY:
+        Address = AbsAddr + cpu.Y;
+        break;
+      case addressing_modes::INDX:
+      {
+        Byte ZPAddress = Operand + cpu.X;
+        accesses[Count++] = { ZPAddress, false };
+        accesses[Count++] = { (Byte)(ZPAddress + 1), false };
+        Address = memory[ZPAddress] | (memory[(Byte)(ZPAddress + 1)] << 8);
+        break;
+      }
+      case addressing_modes::INDY:
+        accesses[Count++] = { Operand, false };
+        accesses[Count++] = { (Byte)(Operand + 1), false };
+        Address = (memory[Operand] | (memory[(Byte)(Operand + 1)] << 8)) + cpu.Y;
+        break;
+      default:
+        return 0;
+    }
+    accesses[Count++] = { Address, info.access == access_types::WRITE };
+    return Count;
+  }
+}
\ No newline at end of file
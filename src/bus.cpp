@@ -0,0 +1,156 @@
+#include "../include/bus.h"
+#include "../include/cpu.h"
+
+namespace EM6502
+{
+  void BUS::present(BUS_CYCLE trace[], u32 count, const MEM& memory, s32 used)
+  {
+    for (u32 i = 0; i < count; i++)
+      if (trace[i].type == bus_cycle_types::WRITE)
+        trace[i].data = memory[trace[i].address];
+    // A device going inactive in its listener still sees the rest of the instruction
+    for (BUS_DEVICE* Device : devices)
+      if (Device->active)
+        for (u32 i = 0; i < count; i++)
+          Device->listener(Device->context, cycle + i, trace[i]);
+    cycle += used;
+  }
+
+  u32 interrupt_cycles(const CPU& cpu, const MEM& memory, Word vector, BUS_CYCLE trace[BUS_MAX_CYCLES])
+  {
+    u32 Count = 0;
+    trace[Count++] = { cpu.PC, memory[cpu.PC], bus_cycle_types::DUMMY_READ };
+    trace[Count++] = { cpu.PC, memory[cpu.PC], bus_cycle_types::DUMMY_READ };
+    for (s32 i = 0; i < 3; i++)
+      trace[Count++] = { (Word)(0x0100 | (Byte)(cpu.SP - i)), 0, bus_cycle_types::WRITE };
+    trace[Count++] = { vector, memory[vector], bus_cycle_types::READ };
+    trace[Count++] = { (Word)(vector + 1), memory[(Word)(vector + 1)], bus_cycle_types::READ };
+    return Count;
+  }
+
+  u32 bus_cycles(const CPU& cpu, const MEM& memory, const INSTRUCTION_INFO* info, BUS_CYCLE trace[BUS_MAX_CYCLES])
+  {
+    u32 Count = 0;
+    auto read = [&](Word address, bus_cycle_types type) {
+      trace[Count++] = { address, memory[address], type };
+    };
+    auto data = [&](Word address) {
+      if (info->access == access_types::WRITE)
+        trace[Count++] = { address, 0, bus_cycle_types::WRITE };
+      else
+        read(address, bus_cycle_types::READ);
+    };
+
+    read(cpu.PC, bus_cycle_types::OPCODE_FETCH);
+    if (!info)
+    {
+      read((Word)(cpu.PC + 1), bus_cycle_types::DUMMY_READ);
+      return Count;
+    }
+
+    // Same address arithmetic as the handlers
+    Byte Operand = memory[(Word)(cpu.PC + 1)];
+    Word AbsAddr = Operand | (memory[(Word)(cpu.PC + 2)] << 8);
+    // The stack wraps within page one, pulls first read the current top while SP is incremented
+    auto stack = [&](s32 offset) {
+      return (Word)(0x0100 | (Byte)(cpu.SP + offset));
+    };
+    switch (info->access)
+    {
+      case access_types::PUSH_WORD:
+        // JSR: the high byte of the target is fetched after the return address is pushed
+        read((Word)(cpu.PC + 1), bus_cycle_types::OPERAND_FETCH);
+        read(stack(0), bus_cycle_types::DUMMY_READ);
+        trace[Count++] = { stack(0), 0, bus_cycle_types::WRITE };
+        trace[Count++] = { stack(-1), 0, bus_cycle_types::WRITE };
+        read((Word)(cpu.PC + 2), bus_cycle_types::OPERAND_FETCH);
+        return Count;
+      case access_types::PUSH_WORD_STATUS:
+        // BRK: the byte after the opcode is read and skipped
+        read((Word)(cpu.PC + 1), bus_cycle_types::DUMMY_READ);
+        for (s32 i = 0; i < 3; i++)
+          trace[Count++] = { stack(-i), 0, bus_cycle_types::WRITE };
+        read(CPU::IRQ_VECTOR, bus_cycle_types::READ);
+        read(CPU::IRQ_VECTOR + 1, bus_cycle_types::READ);
+        return Count;
+      case access_types::PUSH_BYTE:
+        read((Word)(cpu.PC + 1), bus_cycle_types::DUMMY_READ);
+        trace[Count++] = { stack(0), 0, bus_cycle_types::WRITE };
+        return Count;
+      case access_types::PULL_BYTE:
+      case access_types::PULL_WORD:
+      case access_types::PULL_STATUS_WORD:
+      {
+        read((Word)(cpu.PC + 1), bus_cycle_types::DUMMY_READ);
+        read(stack(0), bus_cycle_types::DUMMY_READ);
+        s32 Pulled = info->access == access_types::PULL_BYTE ? 1 : info->access == access_types::PULL_WORD ? 2 : 3;
+        for (s32 i = 1; i <= Pulled; i++)
+          read(stack(i), bus_cycle_types::READ);
+        // RTS reads the pulled address while it increments it
+        if (info->access == access_types::PULL_WORD)
+          read(memory[stack(1)] | (memory[stack(2)] << 8), bus_cycle_types::DUMMY_READ);
+        return Count;
+      }
+      default:
+        break;
+    }
+
+    Byte Size = instruction_size(info->mode);
+    for (Byte i = 1; i < Size; i++)
+      read((Word)(cpu.PC + i), bus_cycle_types::OPERAND_FETCH);
+
+    // An indexed address is first read with the low byte added but not the carry into the high byte
+    auto indexed = [&](Word base, Byte index) {
+      Word Address = base + index;
+      Word Uncarried = (base & 0xFF00) | (Address & 0xFF);
+      if (Uncarried != Address)
+        read(Uncarried, bus_cycle_types::DUMMY_READ);
+      else if (info->access == access_types::WRITE)
+        read(Address, bus_cycle_types::DUMMY_READ);
+      data(Address);
+    };
+    switch (info->mode)
+    {
+      case addressing_modes::IMP:
+        read((Word)(cpu.PC + 1), bus_cycle_types::DUMMY_READ);
+        break;
+      case addressing_modes::ZP:
+        data(Operand);
+        break;
+      case addressing_modes::ZPX:
+        read(Operand, bus_cycle_types::DUMMY_READ);
+        data((Byte)(Operand + cpu.X));
+        break;
+      case addressing_modes::ZPY:
+        read(Operand, bus_cycle_types::DUMMY_READ);
+        data((Byte)(Operand + cpu.Y));
+        break;
+      case addressing_modes::ABS:
+        data(AbsAddr);
+        break;
+      case addressing_modes::ABSX:
+        indexed(AbsAddr, cpu.X);
+        break;
+      case addressing_modes::ABSY:
+        indexed(AbsAddr, cpu.Y);
+        break;
+      case addressing_modes::INDX:
+      {
+        Byte ZPAddress = Operand + cpu.X;
+        read(Operand, bus_cycle_types::DUMMY_READ);
+        read(ZPAddress, bus_cycle_types::READ);
+        read((Byte)(ZPAddress + 1), bus_cycle_types::READ);
+        data(memory[ZPAddress] | (memory[(Byte)(ZPAddress + 1)] << 8));
+        break;
+      }
+      case addressing_modes::INDY:
+        read(Operand, bus_cycle_types::READ);
+        read((Byte)(Operand + 1), bus_cycle_types::READ);
+        indexed(memory[Operand] | (memory[(Byte)(Operand + 1)] << 8), cpu.Y);
+        break;
+      default:
+        break;
+    }
+    return Count;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "../include/fusion.h"
+#include "../include/cpu.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace EM6502
+{
+  void FUSION_PROFILE::write(FILE* file) const
+  {
+    for (auto [Sequence, Count] : pairs)
+      fprintf(file, "pair %04X %u\n", Sequence, Count);
+    for (auto [Sequence, Count] : triples)
+      fprintf(file, "triple %06X %u\n", Sequence, Count);
+  }
+
+  bool FUSION_PROFILE::read(FILE* file)
+  {
+    char Kind[8];
+    u32 Sequence, Count;
+    int Fields;
+    while ((Fields = fscanf(file, "%7s %x %u", Kind, &Sequence, &Count)) == 3)
+    {
+      if (strcmp(Kind, "pair") == 0)
+        pairs[Sequence] += Count;
+      else if (strcmp(Kind, "triple") == 0)
+        triples[Sequence] += Count;
+      else
+        return false;
+    }
+    return Fields == EOF;
+  }
+
+  EXEC_RESULT CPU::exec_profiled(s32 cycles, MEM& memory, FUSION_PROFILE& profile)
+  {
+    const s32 CyclesRequested = cycles;
+    EXEC_RESULT Result{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    u32 History = 0;    // Previous two opcodes, most recent in the low byte
+    u32 Instructions = 0;
+    while (cycles > interrupt_deadline || take_interrupt(cycles, memory))
+    {
+      Byte Instruction = fetch_byte(cycles, memory);
+      auto Handler = instructions.find((opcodes)Instruction);
+      if (Handler != instructions.end())
+        Handler->second(this, cycles, &memory);
+      else if (!exec_unhandled(Instruction, cycles, memory, Result))
+        break;
+
+      if (Instructions >= 1)
+        profile.pairs[(History & 0xFF) | (Instruction << 8)]++;
+      if (Instructions >= 2)
+        profile.triples[((History >> 8) & 0xFF) | ((History & 0xFF) << 8) | (Instruction << 16)]++;
+      History = ((History << 8) | Instruction) & 0xFFFF;
+      Instructions++;
+    }
+    Result.cycles = CyclesRequested - cycles;
+    Result.instructions = Instructions;
+    return Result;
+  }
+
+  u32 CPU::select_fused(const FUSION_PROFILE& profile, u32 max_fused)
+  {
+    clear_fused();
+
+    std::map<u32, const FUSED_INSTRUCTION*> Catalog;
+    for (const FUSED_INSTRUCTION& Fused : fused_instructions())
+      Catalog[Fused.sequence[0] | (Fused.sequence[1] << 8) | (Fused.length == 3 ? Fused.sequence[2] << 16 : 0)] = &Fused;
+
+    // The most frequent pair for each leading opcode, as only one handler can replace it
+    std::map<Byte, std::pair<u32, u32>> Best;    // Leading opcode -> (count, pair)
+    for (auto [Pair, Count] : profile.pairs)
+    {
+      auto& Entry = Best[Pair & 0xFF];
+      if (Catalog.count(Pair) && Count > Entry.first)
+        Entry = { Count, Pair };
+    }
+
+    std::vector<std::pair<u32, u32>> Ranked;
+    for (auto& [Leading, Entry] : Best)
+      if (Entry.first > 0)
+        Ranked.push_back(Entry);
+    std::sort(Ranked.begin(), Ranked.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    if (Ranked.size() > max_fused)
+      Ranked.resize(max_fused);
+
+    for (auto& Entry : Ranked)
+    {
+      u32 Pair = Entry.second;
+      // A triple costs nothing over its pair when the third opcode doesn't follow
+      u32 Sequence = Pair;
+      u32 TripleCount = 0;
+      for (auto [Triple, Count] : profile.triples)
+      {
+        if ((Triple & 0xFFFF) == Pair && Catalog.count(Triple) && Count > TripleCount)
+        {
+          Sequence = Triple;
+          TripleCount = Count;
+        }
+      }
+      dispatch[(opcodes)(Pair & 0xFF)] = Catalog[Sequence]->handler;
+    }
+    return Ranked.size();
+  }
+}
\ No newline at end of file
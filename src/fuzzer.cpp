@@ -0,0 +1,408 @@
+#include "../include/fuzzer.h"
+#include "../include/fusion.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace EM6502
+{
+  /** splitmix64, also used to derive independent seeds */
+  static u64 next_random(u64& state)
+  {
+    u64 Value = (state += 0x9E3779B97F4A7C15ull);
+    Value = (Value ^ (Value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    Value = (Value ^ (Value >> 27)) * 0x94D049BB133111EBull;
+    return Value ^ (Value >> 31);
+  }
+
+  const char* engine_name(engines engine)
+  {
+    switch (engine)
+    {
+      case engines::INTERPRETER: return "interpreter";
+      case engines::FUSED: return "fused";
+      case engines::CHECKED: return "checked";
+      case engines::STEPPED: return "stepped";
+      default: return "?";
+    }
+  }
+
+  bool parse_engine(const char* name, engines& engine)
+  {
+    for (engines Engine : { engines::INTERPRETER, engines::FUSED, engines::CHECKED, engines::STEPPED })
+    {
+      if (strcmp(name, engine_name(Engine)) == 0)
+      {
+        engine = Engine;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  FUZZ_CASE FUZZ_CASE::random(u64 seed, u32 length, bool undocumented)
+  {
+    // Opcodes the interpreter implements, BRK only ends the program
+    std::vector<Byte> Opcodes;
+    for (u32 Opcode = 0; Opcode < 256; Opcode++)
+    {
+      if (Opcode == (Byte)opcodes::INS_BRK)
+        continue;
+      if (instruction_info(Opcode) || (undocumented && undocumented_instruction_info(Opcode)))
+        Opcodes.push_back(Opcode);
+    }
+
+    FUZZ_CASE Case;
+    u64 State = seed;
+    Case.seed = next_random(State);
+    Case.undocumented = undocumented;
+    u32 Size = 0;
+    for (u32 i = 0; i < length; i++)
+    {
+      Byte Opcode = Opcodes[next_random(State) % Opcodes.size()];
+      const INSTRUCTION_INFO* Info = instruction_info(Opcode) ? instruction_info(Opcode) : undocumented_instruction_info(Opcode);
+      std::vector<Byte> Instruction{ Opcode };
+      for (Byte b = 1; b < instruction_size(Info->mode); b++)
+        Instruction.push_back((Byte)next_random(State));
+      Size += Instruction.size();
+      Case.program.push_back(Instruction);
+    }
+
+    u64 Registers = next_random(State);
+    Case.registers = { (Word)(next_random(State) % (MAX_MEM - Size - 1)), (Byte)Registers,
+                       (Register)(Registers >> 8), (Register)(Registers >> 16), (Register)(Registers >> 24), (Byte)(Registers >> 32) };
+    Case.cycles = 1 + next_random(State) % (length * 7);
+    return Case;
+  }
+
+  void FUZZ_CASE::build(CPU& cpu, MEM& memory) const
+  {
+    u64 State = seed;
+    for (u32 Address = 0; Address < MAX_MEM; Address += 8)
+    {
+      u64 Value = next_random(State);
+      memcpy(memory.Data + Address, &Value, 8);
+    }
+    Word Address = registers.PC;
+    for (const std::vector<Byte>& Instruction : program)
+      for (Byte Data : Instruction)
+        memory[Address++] = Data;
+    memory[Address] = (Byte)opcodes::INS_BRK;
+
+    cpu.reset_registers();
+    cpu.set_registers(registers);
+    cpu.illegal_opcode_policy = undocumented ? illegal_opcode_policies::UNDOCUMENTED : illegal_opcode_policies::HALT;
+  }
+
+  std::string FUZZ_CASE::describe() const
+  {
+    char Line[128];
+    snprintf(Line, sizeof(Line), "  memory seed 0x%016llx, %d cycles%s\n  PC=$%04X SP=$%02X A=$%02X X=$%02X Y=$%02X P=$%02X\n",
+             seed, cycles, undocumented ? ", undocumented opcodes" : "", registers.PC, registers.SP, registers.A,
+             registers.X, registers.Y, registers.P);
+    std::string Text = Line;
+    Word Address = registers.PC;
+    for (const std::vector<Byte>& Instruction : program)
+    {
+      const INSTRUCTION_INFO* Info = instruction_info(Instruction[0]);
+      if (!Info)
+        Info = undocumented_instruction_info(Instruction[0]);
+      int Length = snprintf(Line, sizeof(Line), "  $%04X ", Address);
+      for (size_t i = 0; i < 3; i++)
+        Length += snprintf(Line + Length, sizeof(Line) - Length, i < Instruction.size() ? " %02X" : "   ", Instruction[i]);
+      snprintf(Line + Length, sizeof(Line) - Length, "  %s\n", Info ? Info->name : "?");
+      Text += Line;
+      Address += Instruction.size();
+    }
+    return Text;
+  }
+
+  /** Checks that each cycle follows the previous one and sometimes sleeps for a few cycles */
+  static void check_bus_cycle(void* context, u64 cycle, const BUS_CYCLE& access)
+  {
+    FUZZ_MACHINE& Machine = *(FUZZ_MACHINE*)context;
+    if (!Machine.device.active)
+      return;   // Rest of the instruction it went to sleep in
+    if (Machine.next_cycle != UINT64_MAX && cycle != Machine.next_cycle)
+      Machine.bus_gaps++;
+    Machine.next_cycle = cycle + 1;
+    u64 Random = next_random(Machine.random_state);
+    if (access.type == bus_cycle_types::OPCODE_FETCH && Random % 16 == 0)
+    {
+      Machine.device.active = false;
+      Machine.device.wake_cycle = cycle + 1 + (Random >> 8) % 32;
+      Machine.next_cycle = UINT64_MAX;
+    }
+  }
+
+  FUZZ_MACHINE::FUZZ_MACHINE(engines engine, u64 seed) : engine(engine), memory(new MEM), device{ check_bus_cycle, this },
+                                                          next_cycle(UINT64_MAX), bus_gaps(0), random_state(seed), shuffle_seed(seed)
+  {
+    cpu.reset(*memory);
+    if (engine == engines::STEPPED)
+    {
+      bus.attach(device);
+      cpu.bus = &bus;
+    }
+    shuffle(seed);
+  }
+
+  void FUZZ_MACHINE::shuffle(u64 seed)
+  {
+    shuffle_seed = seed;
+    if (engine != engines::FUSED)
+      return;
+    u64 State = seed;
+    // Random counts make select_fused pick a different pair or triple for each leading opcode
+    FUSION_PROFILE Profile;
+    for (const FUSED_INSTRUCTION& Fused : fused_instructions())
+    {
+      u32 Key = Fused.sequence[0] | (Fused.sequence[1] << 8);
+      if (Fused.length == 3)
+        Profile.triples[Key | (Fused.sequence[2] << 16)] = 1 + next_random(State) % 1000;
+      else
+        Profile.pairs[Key] = 1 + next_random(State) % 1000;
+    }
+    cpu.select_fused(Profile, 256);
+  }
+
+  EXEC_RESULT FUZZ_MACHINE::run(const FUZZ_CASE& fuzz_case)
+  {
+    random_state = fuzz_case.seed;
+    fuzz_case.build(cpu, *memory);
+    if (engine == engines::STEPPED)
+    {
+      device.active = true;
+      next_cycle = UINT64_MAX;
+      bus_gaps = 0;
+      u64 Start = bus.cycle;
+      EXEC_RESULT Result = cpu.exec(fuzz_case.cycles, *memory);
+      if (bus.cycle - Start != (u64)Result.cycles || (device.active && next_cycle != UINT64_MAX && next_cycle != bus.cycle))
+        bus_gaps++;
+      return Result;
+    }
+    if (engine != engines::CHECKED)
+      return cpu.exec(fuzz_case.cycles, *memory);
+
+    // Breakpoints on some instructions and watchpoints on random addresses, all transparent once resumed
+    breakpoints.clear();
+    Word Address = fuzz_case.registers.PC;
+    for (const std::vector<Byte>& Instruction : fuzz_case.program)
+    {
+      if (next_random(random_state) % 4 == 0)
+        breakpoints.set_breakpoint(Address);
+      Address += Instruction.size();
+    }
+    for (u32 i = 0; i < 8; i++)
+    {
+      u64 Random = next_random(random_state);
+      breakpoints.set_watchpoint((Word)Random, Random & 0x10000, Random & 0x20000);
+    }
+    cpu.breakpoints = &breakpoints;
+
+    EXEC_RESULT Total{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    EXEC_RESULT Result;
+    do
+    {
+      Result = cpu.exec(fuzz_case.cycles - Total.cycles, *memory);
+      Total.cycles += Result.cycles;
+      Total.instructions += Result.instructions;
+    } while ((Result.reason == halt_reasons::BREAKPOINT || Result.reason == halt_reasons::WATCHPOINT) &&
+             Total.cycles < fuzz_case.cycles);
+    cpu.breakpoints = nullptr;
+    if (Result.reason != halt_reasons::BREAKPOINT && Result.reason != halt_reasons::WATCHPOINT)
+    {
+      Total.reason = Result.reason;
+      Total.address = Result.address;
+    }
+    return Total;
+  }
+
+  s32 first_difference(const MEM& a, const MEM& b)
+  {
+    u32 Address = 0;
+#if defined(__SSE2__)
+    for (; Address < MAX_MEM; Address += 64)
+    {
+      const __m128i* A = (const __m128i*)(a.Data + Address);
+      const __m128i* B = (const __m128i*)(b.Data + Address);
+      __m128i Different = _mm_or_si128(
+        _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(A), _mm_loadu_si128(B)), _mm_xor_si128(_mm_loadu_si128(A + 1), _mm_loadu_si128(B + 1))),
+        _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(A + 2), _mm_loadu_si128(B + 2)), _mm_xor_si128(_mm_loadu_si128(A + 3), _mm_loadu_si128(B + 3))));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(Different, _mm_setzero_si128())) != 0xFFFF)
+        break;
+    }
+#endif
+    for (; Address < MAX_MEM; Address += 8)
+    {
+      u64 A, B;
+      memcpy(&A, a.Data + Address, 8);
+      memcpy(&B, b.Data + Address, 8);
+      if (A != B)
+      {
+        while (a.Data[Address] == b.Data[Address])
+          Address++;
+        return Address;
+      }
+    }
+    return -1;
+  }
+
+  bool run_differs(FUZZ_MACHINE& a, FUZZ_MACHINE& b, const FUZZ_CASE& fuzz_case, std::string* differences)
+  {
+    EXEC_RESULT ResultA = a.run(fuzz_case);
+    EXEC_RESULT ResultB = b.run(fuzz_case);
+    REGISTERS RegistersA = a.cpu.registers();
+    REGISTERS RegistersB = b.cpu.registers();
+    s32 Difference = first_difference(*a.memory, *b.memory);
+
+    const struct { const char* name; u32 a, b; } Values[] = {
+      { "cycles", (u32)ResultA.cycles, (u32)ResultB.cycles },
+      { "instructions", ResultA.instructions, ResultB.instructions },
+      { "halt reason", (u32)ResultA.reason, (u32)ResultB.reason },
+      { "halt address", ResultA.reason == halt_reasons::BUDGET_EXHAUSTED ? 0u : ResultA.address,
+                        ResultB.reason == halt_reasons::BUDGET_EXHAUSTED ? 0u : ResultB.address },
+      { "PC", RegistersA.PC, RegistersB.PC },
+      { "SP", RegistersA.SP, RegistersB.SP },
+      { "A", RegistersA.A, RegistersB.A },
+      { "X", RegistersA.X, RegistersB.X },
+      { "Y", RegistersA.Y, RegistersB.Y },
+      { "P", RegistersA.P, RegistersB.P },
+      { "bus cycles out of sequence", a.bus_gaps, b.bus_gaps },
+    };
+    bool Differs = false;
+    char Line[96];
+    for (const auto& Value : Values)
+    {
+      if (Value.a == Value.b)
+        continue;
+      Differs = true;
+      snprintf(Line, sizeof(Line), "  %s: %u vs %u\n", Value.name, Value.a, Value.b);
+      if (differences)
+        *differences += Line;
+    }
+    if (Difference >= 0)
+    {
+      Differs = true;
+      snprintf(Line, sizeof(Line), "  memory at $%04X: $%02X vs $%02X\n", Difference, (*a.memory)[Difference], (*b.memory)[Difference]);
+      if (differences)
+        *differences += Line;
+    }
+    return Differs;
+  }
+
+  FUZZ_CASE minimize(FUZZ_MACHINE& a, FUZZ_MACHINE& b, FUZZ_CASE fuzz_case)
+  {
+    bool Removed = true;
+    while (Removed)
+    {
+      Removed = false;
+      for (size_t i = 0; i < fuzz_case.program.size();)
+      {
+        FUZZ_CASE Candidate = fuzz_case;
+        Candidate.program.erase(Candidate.program.begin() + i);
+        if (run_differs(a, b, Candidate, nullptr))
+        {
+          fuzz_case = Candidate;
+          Removed = true;
+        }
+        else
+          i++;
+      }
+    }
+    return fuzz_case;
+  }
+
+  int fuzz_command(int argc, char** argv)
+  {
+    engines EngineA, EngineB;
+    u32 Cases = 100000, Seed = 1, Length = 16, Workers = std::max(1u, std::thread::hardware_concurrency()), MaxFailures = 1;
+    bool Undocumented = false;
+    bool Valid = argc >= 2 && parse_engine(argv[0], EngineA) && parse_engine(argv[1], EngineB);
+    for (int i = 2; Valid && i < argc; i++)
+    {
+      if (strcmp(argv[i], "--undocumented") == 0)
+      {
+        Undocumented = true;
+        continue;
+      }
+      u32 Number;
+      Valid = i + 1 < argc && parse_number(argv[i + 1], Number);
+      if (Valid && strcmp(argv[i], "--cases") == 0)
+        Cases = Number;
+      else if (Valid && strcmp(argv[i], "--seed") == 0)
+        Seed = Number;
+      else if (Valid && strcmp(argv[i], "--length") == 0 && Number > 0 && Number < 1000)
+        Length = Number;
+      else if (Valid && strcmp(argv[i], "--jobs") == 0 && Number > 0)
+        Workers = Number;
+      else if (Valid && strcmp(argv[i], "--max-failures") == 0 && Number > 0)
+        MaxFailures = Number;
+      else
+        Valid = false;
+      i++;
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator fuzz <engine> <engine> [--cases count] [--seed number] [--length instructions]"
+                      " [--jobs workers] [--max-failures count] [--undocumented]\n"
+                      "engines: interpreter, fused, checked, stepped\n");
+      return 1;
+    }
+
+    std::atomic<u32> Next{ 0 };
+    std::atomic<u32> Failures{ 0 };
+    std::mutex Output;
+    auto Worker = [&](u32 index)
+    {
+      FUZZ_MACHINE A(EngineA, Seed * 0x10000ull + index * 2);
+      FUZZ_MACHINE B(EngineB, Seed * 0x10000ull + index * 2 + 1);
+      for (u32 Case; Failures < MaxFailures && (Case = Next++) < Cases;)
+      {
+        // The fused handlers change every 256 cases, whichever worker runs them
+        u64 Shuffle = ((u64)Seed << 32 | Case / 256) * 2;
+        if (A.shuffle_seed != Shuffle)
+        {
+          A.shuffle(Shuffle);
+          B.shuffle(Shuffle + 1);
+        }
+        FUZZ_CASE FuzzCase = FUZZ_CASE::random(((u64)Seed << 32) | Case, Length, Undocumented);
+        if (!run_differs(A, B, FuzzCase, nullptr))
+          continue;
+        if (Failures++ >= MaxFailures)
+          break;
+
+        FUZZ_CASE Minimal = minimize(A, B, FuzzCase);
+        std::string Differences;
+        run_differs(A, B, Minimal, &Differences);
+        std::lock_guard<std::mutex> Lock(Output);
+        printf("case %u differs between %s and %s, minimized from %zu to %zu instructions:\n%s%s", Case,
+               engine_name(EngineA), engine_name(EngineB), FuzzCase.program.size(), Minimal.program.size(),
+               Minimal.describe().c_str(), Differences.c_str());
+        if (EngineA == engines::FUSED || EngineB == engines::FUSED)
+          printf("  fused handlers shuffled with seeds %llu and %llu\n", A.shuffle_seed, B.shuffle_seed);
+      }
+    };
+
+    auto Start = std::chrono::steady_clock::now();
+    std::vector<std::thread> Threads;
+    for (u32 i = 1; i < Workers; i++)
+      Threads.emplace_back(Worker, i);
+    Worker(0);
+    for (std::thread& Thread : Threads)
+      Thread.join();
+    double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    u32 Run = std::min(Next.load(), Cases);
+    printf("%u cases of %u instructions in %.2f s (%.0f cases/s) on %u workers, %u differing\n", Run, Length, Seconds,
+           Run / Seconds, Workers, std::min(Failures.load(), MaxFailures));
+    return Failures ? 1 : 0;
+  }
+}
\ No newline at end of file
@@ -1,8 +1,146 @@
 #include "../include/instruction_set.h"
 #include "../include/cpu.h"
+#include <array>
+#include <utility>
 
 namespace EM6502
 {
+  static constexpr INSTRUCTION_ENTRY entry(opcodes opcode, INSTRUCTION handler, const char* name, addressing_modes mode,
+                                           Byte cycles, bool page_penalty = false, flow_types flow = flow_types::NEXT)
+  {
+    bool Reads = mode != addressing_modes::IMP && mode != addressing_modes::IM;
+    return { (Byte)opcode, handler, { name, mode, flow, cycles, page_penalty, Reads ? access_types::READ : access_types::NONE } };
+  }
+
+  static constexpr INSTRUCTION_ENTRY with_access(INSTRUCTION_ENTRY entry, access_types access)
+  {
+    entry.info.access = access;
+    return entry;
+  }
+
+  // The order is the one of the fused handler indexes
+  static constexpr INSTRUCTION_ENTRY BaseInstructions[] = {
+    entry(opcodes::INS_NOP, NOP, "NOP", addressing_modes::IMP, 2),
+    entry(opcodes::INS_LDA_IM, LDA_IM, "LDA_IM", addressing_modes::IM, 2),
+    entry(opcodes::INS_LDA_ZP, LDA_ZP, "LDA_ZP", addressing_modes::ZP, 3),
+    entry(opcodes::INS_LDA_ZPX, LDA_ZPX, "LDA_ZPX", addressing_modes::ZPX, 4),
+    entry(opcodes::INS_LDA_ABS, LDA_ABS, "LDA_ABS", addressing_modes::ABS, 4),
+    entry(opcodes::INS_LDA_ABSX, LDA_ABSX, "LDA_ABSX", addressing_modes::ABSX, 4, true),
+    entry(opcodes::INS_LDA_ABSY, LDA_ABSY, "LDA_ABSY", addressing_modes::ABSY, 4, true),
+    entry(opcodes::INS_LDA_INDX, LDA_INDX, "LDA_INDX", addressing_modes::INDX, 6),
+    entry(opcodes::INS_LDA_INDY, LDA_INDY, "LDA_INDY", addressing_modes::INDY, 5, true),
+    entry(opcodes::INS_LDX_IM, LDX_IM, "LDX_IM", addressing_modes::IM, 2),
+    entry(opcodes::INS_LDX_ZP, LDX_ZP, "LDX_ZP", addressing_modes::ZP, 3),
+    entry(opcodes::INS_LDX_ZPY, LDX_ZPY, "LDX_ZPY", addressing_modes::ZPY, 4),
+    entry(opcodes::INS_LDX_ABS, LDX_ABS, "LDX_ABS", addressing_modes::ABS, 4),
+    entry(opcodes::INS_LDX_ABSY, LDX_ABSY, "LDX_ABSY", addressing_modes::ABSY, 4, true),
+    entry(opcodes::INS_LDY_IM, LDY_IM, "LDY_IM", addressing_modes::IM, 2),
+    entry(opcodes::INS_LDY_ZP, LDY_ZP, "LDY_ZP", addressing_modes::ZP, 3),
+    entry(opcodes::INS_LDY_ZPX, LDY_ZPX, "LDY_ZPX", addressing_modes::ZPX, 4),
+    entry(opcodes::INS_LDY_ABS, LDY_ABS, "LDY_ABS", addressing_modes::ABS, 4),
+    entry(opcodes::INS_LDY_ABSX, LDY_ABSX, "LDY_ABSX", addressing_modes::ABSX, 4, true),
+    with_access(entry(opcodes::INS_JSR, JSR, "JSR", addressing_modes::ABS, 6, false, flow_types::CALL), access_types::PUSH_WORD),
+    with_access(entry(opcodes::INS_RTS, RTS, "RTS", addressing_modes::IMP, 6, false, flow_types::RETURN), access_types::PULL_WORD),
+    with_access(entry(opcodes::INS_RTI, RTI, "RTI", addressing_modes::IMP, 6, false, flow_types::RETURN),
+                access_types::PULL_STATUS_WORD),
+    with_access(entry(opcodes::INS_PHA, PHA, "PHA", addressing_modes::IMP, 3), access_types::PUSH_BYTE),
+    with_access(entry(opcodes::INS_PLA, PLA, "PLA", addressing_modes::IMP, 4), access_types::PULL_BYTE),
+    with_access(entry(opcodes::INS_PHP, PHP, "PHP", addressing_modes::IMP, 3), access_types::PUSH_BYTE),
+    with_access(entry(opcodes::INS_PLP, PLP, "PLP", addressing_modes::IMP, 4), access_types::PULL_BYTE),
+    entry(opcodes::INS_TXS, TXS, "TXS", addressing_modes::IMP, 2),
+    entry(opcodes::INS_TSX, TSX, "TSX", addressing_modes::IMP, 2),
+    entry(opcodes::INS_CLI, CLI, "CLI", addressing_modes::IMP, 2),
+    entry(opcodes::INS_SEI, SEI, "SEI", addressing_modes::IMP, 2)
+  };
+
+  // Run by CPU::exec_unhandled rather than dispatched, so it can halt
+  static constexpr INSTRUCTION_ENTRY BreakInstruction =
+    with_access(entry(opcodes::INS_BRK, BRK, "BRK", addressing_modes::IMP, 7, false, flow_types::BREAK),
+                access_types::PUSH_WORD_STATUS);
+
+  std::span<const INSTRUCTION_ENTRY> instruction_table()
+  {
+    return BaseInstructions;
+  }
+
+  std::span<const INSTRUCTION_ENTRY> undocumented_instruction_table()
+  {
+    static const std::vector<INSTRUCTION_ENTRY> Undocumented = []{
+      std::vector<INSTRUCTION_ENTRY> Entries;
+      auto add = [&Entries](Byte opcode, INSTRUCTION handler, const char* name, addressing_modes mode, Byte cycles,
+                            bool page_penalty = false, access_types access = access_types::READ) {
+        Entries.push_back({ opcode, handler, { name, mode, flow_types::NEXT, cycles, page_penalty, access } });
+      };
+
+      add((Byte)undocumented_opcodes::INS_LAX_ZP, LAX_ZP, "LAX_ZP", addressing_modes::ZP, 3);
+      add((Byte)undocumented_opcodes::INS_LAX_ZPY, LAX_ZPY, "LAX_ZPY", addressing_modes::ZPY, 4);
+      add((Byte)undocumented_opcodes::INS_LAX_ABS, LAX_ABS, "LAX_ABS", addressing_modes::ABS, 4);
+      add((Byte)undocumented_opcodes::INS_LAX_ABSY, LAX_ABSY, "LAX_ABSY", addressing_modes::ABSY, 4, true);
+      add((Byte)undocumented_opcodes::INS_LAX_INDX, LAX_INDX, "LAX_INDX", addressing_modes::INDX, 6);
+      add((Byte)undocumented_opcodes::INS_LAX_INDY, LAX_INDY, "LAX_INDY", addressing_modes::INDY, 5, true);
+      add((Byte)undocumented_opcodes::INS_SAX_ZP, SAX_ZP, "SAX_ZP", addressing_modes::ZP, 3, false, access_types::WRITE);
+      add((Byte)undocumented_opcodes::INS_SAX_ZPY, SAX_ZPY, "SAX_ZPY", addressing_modes::ZPY, 4, false, access_types::WRITE);
+      add((Byte)undocumented_opcodes::INS_SAX_ABS, SAX_ABS, "SAX_ABS", addressing_modes::ABS, 4, false, access_types::WRITE);
+      add((Byte)undocumented_opcodes::INS_SAX_INDX, SAX_INDX, "SAX_INDX", addressing_modes::INDX, 6, false, access_types::WRITE);
+      for (Byte Opcode : { 0x1A, 0x3A, 0x5A, 0x7A, 0xDA, 0xFA })
+        add(Opcode, NOP, "NOP", addressing_modes::IMP, 2, false, access_types::NONE);
+      for (Byte Opcode : { 0x80, 0x82, 0x89, 0xC2, 0xE2 })
+        add(Opcode, NOP_IM, "NOP_IM", addressing_modes::IM, 2, false, access_types::NONE);
+      for (Byte Opcode : { 0x04, 0x44, 0x64 })
+        add(Opcode, NOP_ZP, "NOP_ZP", addressing_modes::ZP, 3);
+      for (Byte Opcode : { 0x14, 0x34, 0x54, 0x74, 0xD4, 0xF4 })
+        add(Opcode, NOP_ZPX, "NOP_ZPX", addressing_modes::ZPX, 4);
+      add(0x0C, NOP_ABS, "NOP_ABS", addressing_modes::ABS, 4);
+      for (Byte Opcode : { 0x1C, 0x3C, 0x5C, 0x7C, 0xDC, 0xFC })
+        add(Opcode, NOP_ABSX, "NOP_ABSX", addressing_modes::ABSX, 4, true);
+      return Entries;
+    }();
+    return Undocumented;
+  }
+
+  static std::array<INSTRUCTION_INFO, 256> info_table(std::span<const INSTRUCTION_ENTRY> entries)
+  {
+    std::array<INSTRUCTION_INFO, 256> Info{};
+    for (const INSTRUCTION_ENTRY& Entry : entries)
+      Info[Entry.opcode] = Entry.info;
+    return Info;
+  }
+
+  static const std::array<INSTRUCTION_INFO, 256> InstructionInfo = []{
+    std::array<INSTRUCTION_INFO, 256> Info = info_table(BaseInstructions);
+    Info[BreakInstruction.opcode] = BreakInstruction.info;
+    return Info;
+  }();
+
+  static const std::array<INSTRUCTION_INFO, 256> UndocumentedInfo = info_table(undocumented_instruction_table());
+
+  const INSTRUCTION_INFO* instruction_info(Byte opcode)
+  {
+    const INSTRUCTION_INFO& Info = InstructionInfo[opcode];
+    return Info.name ? &Info : nullptr;
+  }
+
+  const INSTRUCTION_INFO* undocumented_instruction_info(Byte opcode)
+  {
+    const INSTRUCTION_INFO& Info = UndocumentedInfo[opcode];
+    return Info.name ? &Info : nullptr;
+  }
+
+  Byte instruction_size(addressing_modes mode)
+  {
+    switch (mode)
+    {
+      case addressing_modes::IMP:
+        return 1;
+      case addressing_modes::ABS:
+      case addressing_modes::ABSX:
+      case addressing_modes::ABSY:
+        return 3;
+      default:
+        return 2;
+    }
+  }
+
   void NOP(CPU* cpu, s32& cycles, MEM* memory)
   {
     cycles--;
@@ -38,7 +176,7 @@ namespace EM6502
   {
     Word AbsAddr = cpu->fetch_word(cycles, *memory);
     Word AbsAddrX = AbsAddr + cpu->X;
-    if (AbsAddrX - AbsAddr >= 0xFF)
+    if ((AbsAddr ^ AbsAddrX) & 0xFF00)
       cycles--;
     cpu->load_register(cycles, *memory, AbsAddrX, cpu->A);
   }
@@ -47,7 +185,7 @@ namespace EM6502
   {
     Word AbsAddr = cpu->fetch_word(cycles, *memory);
     Word AbsAddrY = AbsAddr + cpu->Y;
-    if (AbsAddrY - AbsAddr >= 0xFF)
+    if ((AbsAddr ^ AbsAddrY) & 0xFF00)
       cycles--;
     cpu->load_register(cycles, *memory, AbsAddrY, cpu->A);
   }
@@ -57,16 +195,16 @@ namespace EM6502
     Byte ZPAddress = cpu->fetch_byte(cycles, *memory);
 		ZPAddress += cpu->X;
 		cycles--;
-		Word EffectiveAddr = cpu->read_word(cycles, *memory, ZPAddress);
+		Word EffectiveAddr = cpu->read_zero_page_word(cycles, *memory, ZPAddress);
   	cpu->load_register(cycles, *memory, EffectiveAddr, cpu->A);
   }
 
   void LDA_INDY(CPU* cpu, s32& cycles, MEM* memory)
   {
     Byte ZPAddress = cpu->fetch_byte(cycles, *memory);
-    Word EffectiveAddr = cpu->read_word(cycles, *memory, ZPAddress);
+    Word EffectiveAddr = cpu->read_zero_page_word(cycles, *memory, ZPAddress);
     Word EffectiveAddrY = EffectiveAddr + cpu->Y;
-		if(EffectiveAddrY - EffectiveAddr >= 0xFF)
+		if((EffectiveAddr ^ EffectiveAddrY) & 0xFF00)
 		  cycles--;
   	cpu->load_register(cycles, *memory, EffectiveAddrY, cpu->A);
   }
@@ -101,7 +239,7 @@ namespace EM6502
   {
     Word AbsAddr = cpu->fetch_word(cycles, *memory);
     Word AbsAddrY = AbsAddr + cpu->Y;
-    if (AbsAddrY - AbsAddr >= 0xFF)
+    if ((AbsAddr ^ AbsAddrY) & 0xFF00)
       cycles--;
     cpu->load_register(cycles, *memory, AbsAddrY, cpu->X);
   }
@@ -136,7 +274,7 @@ namespace EM6502
   {
     Word AbsAddr = cpu->fetch_word(cycles, *memory);
     Word AbsAddrX = AbsAddr + cpu->X;
-    if (AbsAddrX - AbsAddr >= 0xFF)
+    if ((AbsAddr ^ AbsAddrX) & 0xFF00)
       cycles--;
     cpu->load_register(cycles, *memory, AbsAddrX, cpu->Y);
   }
@@ -144,9 +282,243 @@ namespace EM6502
   void JSR(CPU* cpu, s32& cycles, MEM* memory)
   {
     Word SubAddr = cpu->fetch_word(cycles, *memory);
-    memory->write_word(cycles, cpu->PC - 1, cpu->SP);
-    cpu->SP += 2;
+    cpu->push_word(cycles, *memory, cpu->PC - 1);
+    cpu->push_call(SubAddr, cpu->PC - 1);
     cpu->PC = SubAddr;
     cycles--;
   }
+
+  void RTS(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Word ReturnAddr = cpu->pull_word(cycles, *memory);
+    cpu->pop_call(ReturnAddr);
+    cpu->PC = ReturnAddr + 1;
+    cycles -= 3;
+  }
+
+  void RTI(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    PLP(cpu, cycles, memory);
+    cpu->PC = cpu->pull_word(cycles, *memory);
+    cpu->pop_call(cpu->PC - 1);
+  }
+
+  void PHA(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->push_byte(cycles, *memory, cpu->A);
+    cycles--;
+  }
+
+  void PLA(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->A = cpu->pull_byte(cycles, *memory);
+    cpu->ld_set_status(cpu->A);
+    cycles -= 2;
+  }
+
+  void PHP(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    // B is always set in the pushed copy
+    cpu->push_byte(cycles, *memory, cpu->status() | 0x10);
+    cycles--;
+  }
+
+  void PLP(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    // B only exists in the pushed copies, the pulled one is ignored
+    Byte Break = cpu->B;
+    cpu->set_status(cpu->pull_byte(cycles, *memory));
+    cpu->B = Break;
+    cycles -= 2;
+  }
+
+  void TXS(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->SP = cpu->X;
+    cycles--;
+  }
+
+  void TSX(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->X = cpu->SP;
+    cpu->ld_set_status(cpu->X);
+    cycles--;
+  }
+
+  void BRK(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    // The byte after BRK is skipped, RTI returns after it
+    cpu->PC++;
+    cycles--;
+    cpu->interrupt(cycles, *memory, CPU::IRQ_VECTOR, true);
+  }
+
+  void CLI(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->I = 0;
+    cpu->update_interrupt_deadline();
+    cycles--;
+  }
+
+  void SEI(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->I = 1;
+    cpu->update_interrupt_deadline();
+    cycles--;
+  }
+
+  void LAX_ZP(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDA_ZP(cpu, cycles, memory);
+    cpu->X = cpu->A;
+  }
+
+  void LAX_ZPY(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDX_ZPY(cpu, cycles, memory);
+    cpu->A = cpu->X;
+  }
+
+  void LAX_ABS(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDA_ABS(cpu, cycles, memory);
+    cpu->X = cpu->A;
+  }
+
+  void LAX_ABSY(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDA_ABSY(cpu, cycles, memory);
+    cpu->X = cpu->A;
+  }
+
+  void LAX_INDX(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDA_INDX(cpu, cycles, memory);
+    cpu->X = cpu->A;
+  }
+
+  void LAX_INDY(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    LDA_INDY(cpu, cycles, memory);
+    cpu->X = cpu->A;
+  }
+
+  void SAX_ZP(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Byte ZeroPageAddr = cpu->fetch_byte(cycles, *memory);
+    memory->write_byte(cycles, cpu->A & cpu->X, ZeroPageAddr);
+  }
+
+  void SAX_ZPY(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Byte ZeroPageAddr = cpu->fetch_byte(cycles, *memory);
+    ZeroPageAddr += cpu->Y;
+    cycles--;
+    memory->write_byte(cycles, cpu->A & cpu->X, ZeroPageAddr);
+  }
+
+  void SAX_ABS(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Word AbsAddr = cpu->fetch_word(cycles, *memory);
+    memory->write_byte(cycles, cpu->A & cpu->X, AbsAddr);
+  }
+
+  void SAX_INDX(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Byte ZPAddress = cpu->fetch_byte(cycles, *memory);
+    ZPAddress += cpu->X;
+    cycles--;
+    Word EffectiveAddr = cpu->read_zero_page_word(cycles, *memory, ZPAddress);
+    memory->write_byte(cycles, cpu->A & cpu->X, EffectiveAddr);
+  }
+
+  void NOP_IM(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    cpu->fetch_byte(cycles, *memory);
+  }
+
+  void NOP_ZP(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Byte ZeroPageAddr = cpu->fetch_byte(cycles, *memory);
+    cpu->read_byte(cycles, *memory, ZeroPageAddr);
+  }
+
+  void NOP_ZPX(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Byte ZeroPageAddr = cpu->fetch_byte(cycles, *memory);
+    ZeroPageAddr += cpu->X;
+    cycles--;
+    cpu->read_byte(cycles, *memory, ZeroPageAddr);
+  }
+
+  void NOP_ABS(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Word AbsAddr = cpu->fetch_word(cycles, *memory);
+    cpu->read_byte(cycles, *memory, AbsAddr);
+  }
+
+  void NOP_ABSX(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    Word AbsAddr = cpu->fetch_word(cycles, *memory);
+    Word AbsAddrX = AbsAddr + cpu->X;
+    if ((AbsAddr ^ AbsAddrX) & 0xFF00)
+      cycles--;
+    cpu->read_byte(cycles, *memory, AbsAddrX);
+  }
+}
+
+namespace EM6502
+{
+  static constexpr size_t BaseCount = std::size(BaseInstructions);
+
+  static constexpr size_t base_index(opcodes opcode)
+  {
+    for (size_t i = 0; i < BaseCount; i++)
+      if (BaseInstructions[i].opcode == (Byte)opcode)
+        return i;
+    return BaseCount;
+  }
+
+  // The handlers are known at compile time so they get inlined into a single function
+  template<size_t First, size_t... Rest>
+  static void FUSED(CPU* cpu, s32& cycles, MEM* memory)
+  {
+    BaseInstructions[First].handler(cpu, cycles, memory);
+    ((cycles > cpu->interrupt_deadline && (*memory)[cpu->PC] == BaseInstructions[Rest].opcode &&
+      (cpu->fetch_byte(cycles, *memory), BaseInstructions[Rest].handler(cpu, cycles, memory), cpu->fused_retired++, true)) && ...);
+  }
+
+  template<size_t... I>
+  static void add_fused_pairs(std::vector<FUSED_INSTRUCTION>& fused, std::index_sequence<I...>)
+  {
+    (fused.push_back({ { BaseInstructions[I / BaseCount].opcode, BaseInstructions[I % BaseCount].opcode },
+                       2, FUSED<I / BaseCount, I % BaseCount> }), ...);
+  }
+
+  template<opcodes First, opcodes Second, opcodes Third>
+  static void add_fused_triple(std::vector<FUSED_INSTRUCTION>& fused)
+  {
+    fused.push_back({ { (Byte)First, (Byte)Second, (Byte)Third }, 3,
+                      FUSED<base_index(First), base_index(Second), base_index(Third)> });
+  }
+
+  const std::vector<FUSED_INSTRUCTION>& fused_instructions()
+  {
+    static const std::vector<FUSED_INSTRUCTION> Fused = []{
+      std::vector<FUSED_INSTRUCTION> Fused;
+      add_fused_pairs(Fused, std::make_index_sequence<BaseCount * BaseCount>{});
+      // Register setup, mostly before a call
+      add_fused_triple<opcodes::INS_LDA_IM, opcodes::INS_LDX_IM, opcodes::INS_LDY_IM>(Fused);
+      add_fused_triple<opcodes::INS_LDX_IM, opcodes::INS_LDY_IM, opcodes::INS_JSR>(Fused);
+      add_fused_triple<opcodes::INS_LDA_IM, opcodes::INS_LDX_IM, opcodes::INS_JSR>(Fused);
+      add_fused_triple<opcodes::INS_LDA_ZP, opcodes::INS_LDX_ZP, opcodes::INS_LDY_ZP>(Fused);
+      // Table lookups through a pointer
+      add_fused_triple<opcodes::INS_LDY_IM, opcodes::INS_LDA_INDY, opcodes::INS_LDX_ZP>(Fused);
+      add_fused_triple<opcodes::INS_LDX_IM, opcodes::INS_LDA_ABSX, opcodes::INS_LDY_ABSX>(Fused);
+      // Delay loops
+      add_fused_triple<opcodes::INS_NOP, opcodes::INS_NOP, opcodes::INS_NOP>(Fused);
+      return Fused;
+    }();
+    return Fused;
+  }
 }
\ No newline at end of file
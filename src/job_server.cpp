@@ -0,0 +1,513 @@
+#include "../include/job_server.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define EM6502_HAS_SOCKETS 1
+#endif
+
+namespace EM6502
+{
+  using Clock = std::chrono::steady_clock;
+
+  static const char* const RegisterNames[] = { "pc", "sp", "a", "x", "y", "p" };
+
+  static bool parse_patch(const char* text, MEMORY_PATCH& patch)
+  {
+    const char* Separator = strchr(text, ':');
+    u32 Address;
+    if (!Separator || !parse_number(std::string(text, Separator - text).c_str(), Address) || Address >= MAX_MEM)
+      return false;
+    patch.address = Address;
+    const char* Hex = Separator + 1;
+    size_t Length = strlen(Hex);
+    if (Length == 0 || Length % 2 || Address + Length / 2 > MAX_MEM)
+      return false;
+    for (size_t i = 0; i < Length; i += 2)
+    {
+      char Digits[3] = { Hex[i], Hex[i + 1], 0 };
+      char* End;
+      patch.data.push_back((Byte)strtoul(Digits, &End, 16));
+      if (*End)
+        return false;
+    }
+    return true;
+  }
+
+  bool parse_request(const char* line, JOB_REQUEST& request)
+  {
+    bool HasEntry = false;
+    const char* Position = line + strspn(line, " \t\r\n");
+    while (*Position)
+    {
+      size_t Length = strcspn(Position, " \t\r\n");
+      std::string Field(Position, Length);
+      Position += Length;
+      Position += strspn(Position, " \t\r\n");
+
+      size_t Separator = Field.find('=');
+      if (Separator == std::string::npos)
+        return false;
+      std::string Key = Field.substr(0, Separator);
+      const char* Value = Field.c_str() + Separator + 1;
+      u32 Number;
+
+      if (Key == "patch")
+      {
+        MEMORY_PATCH Patch;
+        if (!parse_patch(Value, Patch))
+          return false;
+        request.patches.push_back(Patch);
+      }
+      else if (Key == "return")
+      {
+        request.returned = 0;
+        for (const char* Name = Value; *Name;)
+        {
+          size_t NameLength = strcspn(Name, ",");
+          u32 i = 0;
+          while (i < 6 && (strlen(RegisterNames[i]) != NameLength || strncmp(Name, RegisterNames[i], NameLength) != 0))
+            i++;
+          if (i == 6)
+            return false;
+          request.returned |= 1 << i;
+          Name += NameLength + (Name[NameLength] == ',');
+        }
+      }
+      else if (!parse_number(Value, Number))
+        return false;
+      else if (Key == "entry" && Number < MAX_MEM)
+      {
+        request.job.entry = Number;
+        HasEntry = true;
+      }
+      else if (Key == "cycles" && Number > 0)
+        request.job.max_cycles = Number;
+      else if (Key == "instructions")
+        request.job.max_instructions = Number;
+      else
+        return false;
+    }
+    return HasEntry;
+  }
+
+  std::string run_request(const JOB_REQUEST& request, const MEM& pristine, CPU& cpu, MEM& memory)
+  {
+    memcpy(memory.Data, pristine.Data, MAX_MEM);
+    cpu.reset_registers();
+    for (const MEMORY_PATCH& Patch : request.patches)
+      memcpy(memory.Data + Patch.address, Patch.data.data(), Patch.data.size());
+    cpu.PC = request.job.entry;
+    BATCH_RESULT Result = execute_job(request.job, cpu, memory);
+
+    char Reply[256];
+    int Length = snprintf(Reply, sizeof(Reply), "{\"status\":\"ok\",\"reason\":\"%s\",\"cycles\":%llu,\"instructions\":%llu",
+                          Result.reason, Result.cycles, Result.instructions);
+    const u32 Values[] = { cpu.PC, cpu.SP, cpu.A, cpu.X, cpu.Y, cpu.status() };
+    for (u32 i = 0; i < 6; i++)
+      if (request.returned & (1 << i))
+        Length += snprintf(Reply + Length, sizeof(Reply) - Length, ",\"%s\":%u", RegisterNames[i], Values[i]);
+    return std::string(Reply) + "}";
+  }
+
+#ifdef EM6502_HAS_SOCKETS
+  static bool write_all(int fd, const std::string& data)
+  {
+    size_t Written = 0;
+    while (Written < data.size())
+    {
+      ssize_t Count = write(fd, data.data() + Written, data.size() - Written);
+      if (Count <= 0)
+        return false;
+      Written += Count;
+    }
+    return true;
+  }
+
+  /** Client of the server, shared by the dispatcher reading its requests and the worker answering one */
+  struct CONNECTION
+  {
+    int fd;
+    std::string pending;        // Bytes read and not answered yet
+    bool reading = true;        // Still polled by the dispatcher
+    bool busy = false;          // Queued or being answered, one request at a time keeps the replies in order
+    bool broken = false;        // A reply couldn't be written, the remaining requests are dropped
+  };
+
+  /** Connections with a whole request line to answer, taken by the workers in arrival order */
+  struct JOB_QUEUE
+  {
+    std::mutex mutex;           // Also guards the CONNECTION fields other than fd
+    std::condition_variable ready;
+    std::deque<std::shared_ptr<CONNECTION>> connections;
+  };
+
+  /** Queues a connection with a whole line pending and no request in flight, or closes it once it's finished */
+  static void update_connection(JOB_QUEUE& queue, const std::shared_ptr<CONNECTION>& connection)
+  {
+    if (connection->busy)
+      return;
+    if (!connection->broken && connection->pending.find('\n') != std::string::npos)
+    {
+      connection->busy = true;
+      queue.connections.push_back(connection);
+      queue.ready.notify_one();
+    }
+    else if (!connection->reading)
+      close(connection->fd);
+  }
+
+  /**
+   * @brief answers queued requests on a warm machine, one line per turn, then puts the connection back at the
+   * end of the queue if it has more, so a client pipelining many requests or sitting idle doesn't hold a worker
+   */
+  static void serve_requests(JOB_QUEUE& queue, const MEM& pristine, std::atomic<u64>& served)
+  {
+    std::unique_ptr<MEM> Memory(new MEM);
+    CPU cpu;
+    cpu.reset(*Memory);
+    std::unique_lock<std::mutex> Lock(queue.mutex);
+    while (true)
+    {
+      queue.ready.wait(Lock, [&]() { return !queue.connections.empty(); });
+      std::shared_ptr<CONNECTION> Connection = queue.connections.front();
+      queue.connections.pop_front();
+      size_t End = Connection->pending.find('\n');
+      std::string Line = Connection->pending.substr(0, End);
+      Connection->pending.erase(0, End + 1);
+      Lock.unlock();
+
+      JOB_REQUEST Request;
+      std::string Reply;
+      if (parse_request(Line.c_str(), Request))
+      {
+        Reply = run_request(Request, pristine, cpu, *Memory);
+        served++;
+      }
+      else
+        Reply = "{\"status\":\"error\",\"error\":\"malformed request\"}";
+      bool Written = write_all(Connection->fd, Reply + '\n');
+
+      Lock.lock();
+      Connection->busy = false;
+      if (!Written)
+      {
+        Connection->broken = true;
+        Connection->pending.clear();
+      }
+      update_connection(queue, Connection);
+    }
+  }
+
+  /** Accepts clients and reads their requests, until the listener is closed */
+  static void dispatch_requests(int listener, JOB_QUEUE& queue)
+  {
+    std::vector<std::shared_ptr<CONNECTION>> Connections;
+    std::vector<pollfd> Polled;
+    char Buffer[4096];
+    while (true)
+    {
+      Polled.assign(1, pollfd{ listener, POLLIN, 0 });
+      for (auto& Connection : Connections)
+        Polled.push_back(pollfd{ Connection->fd, POLLIN, 0 });
+      if (poll(Polled.data(), Polled.size(), -1) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      if (Polled[0].revents & (POLLERR | POLLNVAL))
+        return;
+
+      std::vector<std::shared_ptr<CONNECTION>> Open;
+      for (size_t i = 0; i < Connections.size(); i++)
+      {
+        std::shared_ptr<CONNECTION>& Connection = Connections[i];
+        if (!Polled[i + 1].revents)
+        {
+          Open.push_back(Connection);
+          continue;
+        }
+        ssize_t Count = read(Connection->fd, Buffer, sizeof(Buffer));
+        std::lock_guard<std::mutex> Lock(queue.mutex);
+        if (Count > 0 && !Connection->broken)
+          Connection->pending.append(Buffer, Count);
+        if (Count > 0 || (Count < 0 && errno == EINTR))
+          Open.push_back(Connection);
+        else
+          Connection->reading = false;
+        update_connection(queue, Connection);
+      }
+      Connections.swap(Open);
+
+      if (Polled[0].revents & POLLIN)
+      {
+        int Fd = accept(listener, nullptr, nullptr);
+        if (Fd >= 0)
+          Connections.push_back(std::make_shared<CONNECTION>(CONNECTION{ Fd }));
+      }
+    }
+  }
+
+  static int connect_to(const char* path)
+  {
+    int Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address{};
+    Address.sun_family = AF_UNIX;
+    strncpy(Address.sun_path, path, sizeof(Address.sun_path) - 1);
+    if (Fd >= 0 && connect(Fd, (sockaddr*)&Address, sizeof(Address)) != 0)
+    {
+      close(Fd);
+      Fd = -1;
+    }
+    return Fd;
+  }
+#endif
+
+  int serve_command(int argc, char** argv)
+  {
+#ifdef EM6502_HAS_SOCKETS
+    static MEM Pristine;
+    Pristine.initialize();
+    u32 Workers = std::max(1u, std::thread::hardware_concurrency());
+    bool Valid = argc >= 1 && strlen(argv[0]) < sizeof(sockaddr_un::sun_path);
+    for (int i = 1; Valid && i < argc; i += 2)
+    {
+      u32 Number;
+      Valid = i + 1 < argc && parse_number(argv[i + 1], Number);
+      if (!Valid)
+        break;
+      if (strcmp(argv[i], "--workers") == 0)
+      {
+        Valid = Number > 0;
+        Workers = Number;
+      }
+      else if (Number >= MAX_MEM || !Pristine.load_program(argv[i], Number))
+      {
+        fprintf(stderr, "can't load %s at %s\n", argv[i], argv[i + 1]);
+        return 1;
+      }
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator serve <socket path> [<image> <load address>]... [--workers count]\n"
+                      "requests: entry=N [cycles=N] [instructions=N] [patch=<address>:<hex bytes>]... [return=pc,sp,a,x,y,p]\n");
+      return 1;
+    }
+
+    int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address{};
+    Address.sun_family = AF_UNIX;
+    strncpy(Address.sun_path, argv[0], sizeof(Address.sun_path) - 1);
+    unlink(argv[0]);
+    if (Listener < 0 || bind(Listener, (sockaddr*)&Address, sizeof(Address)) != 0 || listen(Listener, 128) != 0)
+    {
+      fprintf(stderr, "can't listen on %s: %s\n", argv[0], strerror(errno));
+      return 1;
+    }
+
+    // The workers inherit the blocked signals, so only sigwait below sees them
+    sigset_t Signals;
+    sigemptyset(&Signals);
+    sigaddset(&Signals, SIGINT);
+    sigaddset(&Signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &Signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    // One thread reads every connection and queues its requests, each worker owns a warm machine and answers
+    // them one at a time, so any number of clients share the workers
+    // Never destroyed: the detached workers are still waiting on it when the process exits
+    JOB_QUEUE& Queue = *new JOB_QUEUE;
+    std::atomic<u64> Served{ 0 };
+    for (u32 i = 0; i < Workers; i++)
+      std::thread(serve_requests, std::ref(Queue), std::cref(Pristine), std::ref(Served)).detach();
+    std::thread(dispatch_requests, Listener, std::ref(Queue)).detach();
+    printf("serving on %s with %u workers\n", argv[0], Workers);
+    fflush(stdout);
+
+    int Signal;
+    sigwait(&Signals, &Signal);
+    close(Listener);
+    unlink(argv[0]);
+    printf("served %llu jobs\n", Served.load());
+    return 0;
+#else
+    fprintf(stderr, "serve needs Unix domain sockets\n");
+    return 1;
+#endif
+  }
+
+#ifdef EM6502_HAS_SOCKETS
+  /** Runs jobs on parallel clients, each made by job() and called until it returns false, and prints the latencies; a client is destroyed when its loop ends */
+  template<typename JOB>
+  static bool measure(const char* title, u32 jobs, u32 clients, JOB job)
+  {
+    std::vector<std::vector<double>> Latencies(clients);
+    std::atomic<bool> Failed{ false };
+    auto Start = Clock::now();
+    std::vector<std::thread> Threads;
+    for (u32 c = 0; c < clients; c++)
+    {
+      Threads.emplace_back([&, c]()
+      {
+        auto Client = job();
+        for (u32 i = c; i < jobs && !Failed; i += clients)
+        {
+          auto JobStart = Clock::now();
+          if (!Client())
+          {
+            Failed = true;
+            break;
+          }
+          Latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - JobStart).count());
+        }
+      });
+    }
+    for (std::thread& Thread : Threads)
+      Thread.join();
+    double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+    if (Failed)
+    {
+      fprintf(stderr, "%s: a job failed\n", title);
+      return false;
+    }
+
+    std::vector<double> All;
+    for (auto& Client : Latencies)
+      All.insert(All.end(), Client.begin(), Client.end());
+    std::sort(All.begin(), All.end());
+    auto percentile = [&](double p) { return All.empty() ? 0 : All[std::min(All.size() - 1, (size_t)(p * All.size()))]; };
+    printf("%-8s %8zu jobs %10.1f jobs/s  p50 %10.1f us  p99 %10.1f us\n", title, All.size(), All.size() / Seconds,
+           percentile(0.5), percentile(0.99));
+    return true;
+  }
+#endif
+
+  int loadgen_command(int argc, char** argv)
+  {
+#ifdef EM6502_HAS_SOCKETS
+    u32 LoadAddress, Entry, Jobs = 10000, Clients = 1, Spawned = 200, Cycles = 10000;
+    bool Valid = argc >= 4 && parse_number(argv[2], LoadAddress) && LoadAddress < MAX_MEM &&
+                 parse_number(argv[3], Entry) && Entry < MAX_MEM;
+    for (int i = 4; Valid && i < argc; i += 2)
+    {
+      u32 Number;
+      Valid = i + 1 < argc && parse_number(argv[i + 1], Number);
+      if (Valid && strcmp(argv[i], "--jobs") == 0)
+        Jobs = Number;
+      else if (Valid && strcmp(argv[i], "--clients") == 0 && Number > 0)
+        Clients = Number;
+      else if (Valid && strcmp(argv[i], "--spawn") == 0)
+        Spawned = Number;
+      else if (Valid && strcmp(argv[i], "--cycles") == 0 && Number > 0)
+        Cycles = Number;
+      else
+        Valid = false;
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator loadgen <socket path> <program> <load address> <entry> [--jobs count]"
+                      " [--clients count] [--spawn count] [--cycles limit]\n"
+                      "the server must have been started with the same program: emulator serve <socket path> <program> <load address>\n");
+      return 1;
+    }
+
+    char Request[64];
+    snprintf(Request, sizeof(Request), "entry=%u cycles=%u\n", Entry, Cycles);
+    const char* SocketPath = argv[0];
+    bool Measured = measure("server", Jobs, Clients, [&]()
+    {
+      // The client closes its connection when measure() drops it at the end of its job loop
+      std::shared_ptr<int> Socket(new int(connect_to(SocketPath)), [](int* Fd)
+      {
+        if (*Fd >= 0)
+          close(*Fd);
+        delete Fd;
+      });
+      return [Socket, &Request]()
+      {
+        int Fd = *Socket;
+        if (Fd < 0 || !write_all(Fd, Request))
+          return false;
+        char Reply[512];
+        size_t Length = 0;
+        ssize_t Count;
+        while ((Count = read(Fd, Reply + Length, sizeof(Reply) - Length)) > 0)
+        {
+          Length += Count;
+          if (Reply[Length - 1] == '\n')
+            return true;
+          if (Length == sizeof(Reply))
+            return false;
+        }
+        return false;
+      };
+    });
+    if (!Measured)
+      return 1;
+    if (Spawned == 0)
+      return 0;
+
+    // The same job through "emulator run", one process per job
+    char Executable[4096];
+    ssize_t ExecutableLength = readlink("/proc/self/exe", Executable, sizeof(Executable) - 1);
+    char ProgramPath[4096];
+    if (ExecutableLength <= 0 || !realpath(argv[1], ProgramPath))
+    {
+      fprintf(stderr, "can't find the emulator executable or the program to spawn\n");
+      return 1;
+    }
+    Executable[ExecutableLength] = '\0';
+    char Manifest[] = "/tmp/em6502_loadgen_XXXXXX";
+    int ManifestFd = mkstemp(Manifest);
+    std::string Line = std::string(ProgramPath) + " " + std::to_string(LoadAddress) + " " + std::to_string(Entry) +
+                       " cycles=" + std::to_string(Cycles) + "\n";
+    if (ManifestFd < 0 || !write_all(ManifestFd, Line))
+    {
+      fprintf(stderr, "can't write a manifest in /tmp\n");
+      return 1;
+    }
+    close(ManifestFd);
+
+    Measured = measure("spawn", Spawned, Clients, [&]()
+    {
+      return [&]()
+      {
+        char Run[] = "run", Workers[] = "--jobs", One[] = "1";
+        char* Arguments[] = { Executable, Run, Manifest, Workers, One, nullptr };
+        posix_spawn_file_actions_t Actions;
+        posix_spawn_file_actions_init(&Actions);
+        posix_spawn_file_actions_addopen(&Actions, 1, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&Actions, 2, "/dev/null", O_WRONLY, 0);
+        pid_t Pid;
+        int Status = 1;
+        bool Finished = posix_spawn(&Pid, Executable, &Actions, nullptr, Arguments, nullptr) == 0 &&
+                        waitpid(Pid, &Status, 0) == Pid;
+        posix_spawn_file_actions_destroy(&Actions);
+        return Finished && WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+      };
+    });
+    unlink(Manifest);
+    return Measured ? 0 : 1;
+#else
+    fprintf(stderr, "loadgen needs Unix domain sockets\n");
+    return 1;
+#endif
+  }
+}
\ No newline at end of file
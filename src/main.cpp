@@ -1,13 +1,47 @@
 #include "../include/cpu.h"
 #include "../include/tests.h"
+#include "../include/recompiler.h"
+#include "../include/bench.h"
+#include "../include/shared_mem.h"
+#include "../include/pacer.h"
+#include "../include/profiler.h"
+#include "../include/batch.h"
+#include "../include/job_server.h"
+#include "../include/fuzzer.h"
+#include "../include/wcet.h"
+#include "../include/test_matrix.h"
 #include <iostream>
+#include <string.h>
 
 using namespace EM6502;
 
 // https://web.archive.org/web/20210909190432/http://www.obelisk.me.uk/6502/
 
-int main()
+int main(int argc, char** argv)
 {
+    if (argc > 1 && strcmp(argv[1], "recompile") == 0)
+        return recompile_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return bench_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "share") == 0)
+        return share_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "monitor") == 0)
+        return monitor_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "pace") == 0)
+        return pace_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "profile") == 0)
+        return profile_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "run") == 0)
+        return run_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "serve") == 0)
+        return serve_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "loadgen") == 0)
+        return loadgen_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "fuzz") == 0)
+        return fuzz_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "wcet") == 0)
+        return wcet_command(argc - 2, argv + 2);
+
     MEM memory;
     CPU cpu;
     cpu.reset(memory);
@@ -15,6 +49,7 @@ int main()
     TESTS tests{};
     tests.InitializeTests();
     tests.RunTests(cpu, memory);
+    run_test_matrix(cpu, memory, stdout);
 
     return 0;
 }
\ No newline at end of file
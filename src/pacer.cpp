@@ -0,0 +1,117 @@
+#include "../include/pacer.h"
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+namespace EM6502
+{
+  RUN_RESULT PACER::run(CPU& cpu, MEM& memory, u64 cycles)
+  {
+    slices = late_slices = resyncs = 0;
+    max_drift_us = final_drift_us = 0;
+    std::fill(std::begin(jitter), std::end(jitter), 0);
+
+    RUN_RESULT Total{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    Clock::time_point Start = Clock::now();
+    u64 Scheduled = 0;  // Cycles since Start
+    auto Spin = std::min(max_spin, std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(slice_cycles / frequency * spin_fraction)));
+    while (Total.cycles < cycles)
+    {
+      EXEC_RESULT Result = cpu.exec((s32)std::min<u64>(slice_cycles, cycles - Total.cycles), memory);
+      Scheduled += Result.cycles;
+      Total.cycles += Result.cycles;
+      Total.instructions += Result.instructions;
+      slices++;
+
+      auto Deadline = Start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(Scheduled / frequency));
+      auto Now = Clock::now();
+      if (Now < Deadline)
+      {
+        if (Deadline - Now > Spin)
+          std::this_thread::sleep_until(Deadline - Spin);
+        while ((Now = Clock::now()) < Deadline)
+          ;
+      }
+      else
+        late_slices++;
+
+      double LateUs = std::chrono::duration<double, std::micro>(Now - Deadline).count();
+      u32 Bucket = 0;
+      while (Bucket + 1 < JITTER_BUCKETS && LateUs >= (double)(1u << Bucket))
+        Bucket++;
+      jitter[Bucket]++;
+      max_drift_us = std::max(max_drift_us, LateUs);
+      final_drift_us = LateUs;
+
+      if (Now - Deadline > max_lag)
+      {
+        Start = Now;
+        Scheduled = 0;
+        resyncs++;
+      }
+
+      if (Result.reason != halt_reasons::BUDGET_EXHAUSTED)
+      {
+        Total.reason = Result.reason;
+        Total.address = Result.address;
+        break;
+      }
+    }
+    return Total;
+  }
+
+  void PACER::report(FILE* out) const
+  {
+    fprintf(out, "%.0f Hz, %llu slices of %d cycles, %llu late, %llu resyncs\n", frequency, slices, slice_cycles,
+            late_slices, resyncs);
+    fprintf(out, "drift: max %.1f us, final %.1f us\n", max_drift_us, final_drift_us);
+    fprintf(out, "wake up lateness:\n");
+    for (u32 i = 0; i < JITTER_BUCKETS; i++)
+      if (jitter[i])
+        fprintf(out, "  < %7u us %10llu\n", 1u << i, jitter[i]);
+  }
+
+  /** Parses a whole argument as a positive number, so that e.g. "1MHz" is rejected instead of read as 1 */
+  static bool parse_positive(const char* text, double& value)
+  {
+    char* End;
+    value = strtod(text, &End);
+    return End != text && *End == '\0' && std::isfinite(value) && value > 0;
+  }
+
+  int pace_command(int argc, char** argv)
+  {
+    u32 LoadAddress, Entry;
+    double Frequency = 0, Seconds = 1;
+    if (argc < 4 || !parse_number(argv[1], LoadAddress) || LoadAddress >= MAX_MEM ||
+        !parse_number(argv[2], Entry) || Entry >= MAX_MEM || !parse_positive(argv[3], Frequency) ||
+        (argc > 4 && !parse_positive(argv[4], Seconds)) || Frequency / 1000 > 0x7FFFFFFF || Frequency * Seconds > 1e18)
+    {
+      fprintf(stderr, "usage: emulator pace <program> <load address> <entry> <frequency Hz> [seconds]\n");
+      return 1;
+    }
+
+    static MEM memory;
+    CPU cpu;
+    cpu.reset(memory);
+    if (!memory.load_program(argv[0], LoadAddress))
+    {
+      fprintf(stderr, "can't load %s at $%04X\n", argv[0], LoadAddress);
+      return 1;
+    }
+    cpu.PC = Entry;
+
+    PACER Pacer(Frequency);
+    // About a millisecond per slice
+    Pacer.slice_cycles = std::max<s32>(100, (s32)(Frequency / 1000));
+    auto Start = PACER::Clock::now();
+    RUN_RESULT Result = Pacer.run(cpu, memory, (u64)(Frequency * Seconds));
+    double Elapsed = std::chrono::duration<double>(PACER::Clock::now() - Start).count();
+
+    printf("%llu cycles in %.6f s (%.0f Hz effective), halt reason %d\n", Result.cycles, Elapsed,
+           Result.cycles / Elapsed, (int)Result.reason);
+    Pacer.report(stdout);
+    return 0;
+  }
+}
\ No newline at end of file
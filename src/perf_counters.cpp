@@ -0,0 +1,113 @@
+#include "../include/perf_counters.h"
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace EM6502
+{
+  PERF_COUNTERS::PERF_COUNTERS()
+  {
+    for (u32 i = 0; i < (u32)perf_events::COUNT; i++)
+    {
+      fds[i] = -1;
+      values[i] = 0;
+    }
+  }
+
+  PERF_COUNTERS::~PERF_COUNTERS()
+  {
+#ifdef __linux__
+    for (int Fd : fds)
+      if (Fd >= 0)
+        close(Fd);
+#endif
+  }
+
+  const char* PERF_COUNTERS::name(perf_events event)
+  {
+    switch (event)
+    {
+      case perf_events::CYCLES: return "cycles";
+      case perf_events::INSTRUCTIONS: return "instructions";
+      case perf_events::BRANCH_MISSES: return "branch-misses";
+      case perf_events::L1D_MISSES: return "L1-dcache-misses";
+      case perf_events::ITLB_MISSES: return "iTLB-misses";
+      default: return "?";
+    }
+  }
+
+  bool PERF_COUNTERS::open()
+  {
+#ifdef __linux__
+    auto cache = [](u64 cache, u64 op, u64 result) { return cache | (op << 8) | (result << 16); };
+    const struct { u32 type; u64 config; } Events[] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+      { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+      { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    };
+
+    bool Any = false;
+    for (u32 i = 0; i < (u32)perf_events::COUNT; i++)
+    {
+      perf_event_attr Attr;
+      memset(&Attr, 0, sizeof(Attr));
+      Attr.size = sizeof(Attr);
+      Attr.type = Events[i].type;
+      Attr.config = Events[i].config;
+      Attr.disabled = 1;
+      Attr.exclude_kernel = 1;
+      Attr.exclude_hv = 1;
+      Attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+      if (fds[i] >= 0)
+        Any = true;
+      else
+        last_error = strerror(errno);
+    }
+    if (Any)
+      last_error = nullptr;
+    return Any;
+#else
+    last_error = "perf_event_open is only available on Linux";
+    return false;
+#endif
+  }
+
+  void PERF_COUNTERS::start()
+  {
+#ifdef __linux__
+    for (int Fd : fds)
+    {
+      if (Fd >= 0)
+      {
+        ioctl(Fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(Fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  void PERF_COUNTERS::stop()
+  {
+#ifdef __linux__
+    for (u32 i = 0; i < (u32)perf_events::COUNT; i++)
+    {
+      values[i] = 0;
+      if (fds[i] < 0)
+        continue;
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      u64 Data[3];    // Value, time enabled, time running
+      if (read(fds[i], Data, sizeof(Data)) == sizeof(Data) && Data[2] > 0)
+        values[i] = Data[2] < Data[1] ? (u64)((double)Data[0] * Data[1] / Data[2]) : Data[0];
+    }
+#endif
+  }
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "../include/profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+namespace EM6502
+{
+  bool SYMBOLS::load(const char* path)
+  {
+    FILE* File = fopen(path, "r");
+    if (!File)
+      return false;
+
+    char Line[1024];
+    while (fgets(Line, sizeof(Line), File))
+    {
+      char Name[256];
+      u32 Address;
+      if (strncmp(Line, "al ", 3) == 0)
+      {
+        // VICE: al C:8000 .main
+        if (sscanf(Line, "al %*[^:]:%x .%255s", &Address, Name) != 2)
+          continue;
+      }
+      else if (strncmp(Line, "sym", 3) == 0)
+      {
+        // ld65 debug file: sym id=0,name="main",addrsize=absolute,...,val=0x8000,...,type=lab
+        const char* NameField = strstr(Line, "name=\"");
+        const char* ValueField = strstr(Line, "val=");
+        if (!NameField || !ValueField || !strstr(Line, "type=lab"))
+          continue;
+        if (sscanf(NameField, "name=\"%255[^\"]\"", Name) != 1 || sscanf(ValueField, "val=%i", (int*)&Address) != 1)
+          continue;
+      }
+      else
+        continue;
+
+      if (Name[0] == '@' || Address >= MAX_MEM)
+        continue;
+      labels[Address] = Name;
+    }
+    fclose(File);
+    return true;
+  }
+
+  s32 SYMBOLS::routine(Word address) const
+  {
+    auto it = labels.upper_bound(address);
+    if (it == labels.begin())
+      return -1;
+    return std::prev(it)->first;
+  }
+
+  std::string SYMBOLS::name(s32 routine) const
+  {
+    auto it = labels.find(routine);
+    if (it != labels.end())
+      return it->second;
+    char Name[8];
+    snprintf(Name, sizeof(Name), routine < 0 ? "?" : "$%04X", routine);
+    return Name;
+  }
+
+  void PROFILER::sample(const CPU& cpu, u64 cycles)
+  {
+    std::vector<s32> Stack;
+    u32 Depth = std::min(cpu.call_depth, CPU::CALL_STACK_SIZE);
+    Stack.reserve(Depth + 1);
+    for (u32 i = 0; i < Depth; i++)
+    {
+      // Without labels, routines are the JSR targets
+      Word Target = cpu.call_stack[i].target;
+      s32 Routine = symbols.labels.empty() ? Target : symbols.routine(Target);
+      if (Stack.empty() || Stack.back() != Routine)
+        Stack.push_back(Routine);
+    }
+    s32 Leaf = symbols.labels.empty() ? (Stack.empty() ? -1 : Stack.back()) : symbols.routine(cpu.PC);
+    if (Stack.empty() || Stack.back() != Leaf)
+      Stack.push_back(Leaf);
+
+    self[Leaf] += cycles;
+    std::vector<s32> Seen;
+    for (s32 Routine : Stack)
+    {
+      if (std::find(Seen.begin(), Seen.end(), Routine) == Seen.end())
+      {
+        inclusive[Routine] += cycles;
+        Seen.push_back(Routine);
+      }
+    }
+    stacks[Stack] += cycles;
+    samples++;
+  }
+
+  RUN_RESULT PROFILER::run(CPU& cpu, MEM& memory, u64 cycles)
+  {
+    using Clock = std::chrono::steady_clock;
+    RUN_RESULT Total{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    while (Total.cycles < cycles)
+    {
+      EXEC_RESULT Result = cpu.exec((s32)std::min<u64>(interval, cycles - Total.cycles), memory);
+      Total.cycles += Result.cycles;
+      Total.instructions += Result.instructions;
+
+      auto Start = Clock::now();
+      sample(cpu, Result.cycles);
+      sampling_seconds += std::chrono::duration<double>(Clock::now() - Start).count();
+
+      if (Result.reason != halt_reasons::BUDGET_EXHAUSTED)
+      {
+        Total.reason = Result.reason;
+        Total.address = Result.address;
+        break;
+      }
+    }
+    return Total;
+  }
+
+  void PROFILER::report(FILE* out) const
+  {
+    u64 Total = 0;
+    for (auto& [Routine, Cycles] : self)
+      Total += Cycles;
+    std::vector<std::pair<u64, s32>> Sorted;
+    for (auto& [Routine, Cycles] : self)
+      Sorted.push_back({ Cycles, Routine });
+    for (auto& [Routine, Cycles] : inclusive)
+      if (!self.count(Routine))
+        Sorted.push_back({ 0, Routine });
+    std::sort(Sorted.rbegin(), Sorted.rend());
+
+    fprintf(out, "%-32s %14s %7s %14s %7s\n", "routine", "self cycles", "self%", "inclusive", "incl%");
+    for (auto& [Cycles, Routine] : Sorted)
+    {
+      u64 Inclusive = inclusive.count(Routine) ? inclusive.at(Routine) : 0;
+      fprintf(out, "%-32s %14llu %6.2f%% %14llu %6.2f%%\n", symbols.name(Routine).c_str(), Cycles,
+              Total ? 100.0 * Cycles / Total : 0, Inclusive, Total ? 100.0 * Inclusive / Total : 0);
+    }
+  }
+
+  void PROFILER::write_folded(FILE* out) const
+  {
+    for (auto& [Stack, Cycles] : stacks)
+    {
+      for (size_t i = 0; i < Stack.size(); i++)
+        fprintf(out, "%s%s", i ? ";" : "", symbols.name(Stack[i]).c_str());
+      fprintf(out, " %llu\n", Cycles);
+    }
+  }
+
+  int profile_command(int argc, char** argv)
+  {
+    u32 LoadAddress, Entry, Cycles, Interval = 1000;
+    const char* LabelsPath = nullptr;
+    const char* FoldedPath = nullptr;
+    bool Valid = argc >= 4 && parse_number(argv[1], LoadAddress) && LoadAddress < MAX_MEM &&
+                 parse_number(argv[2], Entry) && Entry < MAX_MEM && parse_number(argv[3], Cycles);
+    for (int i = 4; Valid && i < argc; i++)
+    {
+      if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc)
+        LabelsPath = argv[++i];
+      else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc)
+        FoldedPath = argv[++i];
+      else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        Valid = parse_number(argv[++i], Interval) && Interval > 0 && Interval <= 0x7FFFFFFF;
+      else
+        Valid = false;
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator profile <program> <load address> <entry> <cycles>"
+                      " [--labels file] [--interval cycles] [--folded file]\n");
+      return 1;
+    }
+
+    SYMBOLS Symbols;
+    if (LabelsPath && !Symbols.load(LabelsPath))
+    {
+      fprintf(stderr, "can't read %s\n", LabelsPath);
+      return 1;
+    }
+
+    static MEM memory;
+    CPU cpu;
+    cpu.reset(memory);
+    if (!memory.load_program(argv[0], LoadAddress))
+    {
+      fprintf(stderr, "can't load %s at $%04X\n", argv[0], LoadAddress);
+      return 1;
+    }
+    cpu.PC = Entry;
+
+    PROFILER Profiler(Symbols, Interval);
+    auto Start = std::chrono::steady_clock::now();
+    RUN_RESULT Result = Profiler.run(cpu, memory, Cycles);
+    double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    printf("%llu cycles, %llu samples every %u cycles, halt reason %d, sampling overhead %.2f%%\n", Result.cycles,
+           Profiler.samples, Interval, (int)Result.reason, 100.0 * Profiler.sampling_seconds / Seconds);
+    Profiler.report(stdout);
+
+    if (FoldedPath)
+    {
+      FILE* Folded = fopen(FoldedPath, "w");
+      if (!Folded)
+      {
+        fprintf(stderr, "can't write %s\n", FoldedPath);
+        return 1;
+      }
+      Profiler.write_folded(Folded);
+      fclose(Folded);
+    }
+    return 0;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "../include/recompiler.h"
+#include <string.h>
+
+namespace EM6502
+{
+  void RECOMPILER::trace(const MEM& memory)
+  {
+    code.clear();
+    std::vector<Word> Pending(entries.begin(), entries.end());
+    while (!Pending.empty())
+    {
+      Word Address = Pending.back();
+      Pending.pop_back();
+      while (in_rom(Address) && !code.count(Address))
+      {
+        const INSTRUCTION_INFO* Info = instruction_info(memory[Address]);
+        // BRK is left to CPU::exec, which halts on it or interrupts
+        if (!Info || Info->flow == flow_types::BREAK)
+          break;
+        Byte Size = instruction_size(Info->mode);
+        if (!in_rom(Address + Size - 1))
+          break;
+        code[Address] = Info;
+
+        if (Info->flow == flow_types::CALL)
+          Pending.push_back(memory[Address + 1] | (memory[Address + 2] << 8));
+        if (Info->flow == flow_types::RETURN)
+          break;
+        Address += Size;
+      }
+    }
+  }
+
+  void RECOMPILER::emit(FILE* out, const MEM& memory, const char* name, bool with_main) const
+  {
+    fprintf(out, "// Generated by \"emulator recompile\", do not edit.\n");
+    fprintf(out, "#include \"cpu.h\"\n");
+    if (with_main)
+      fprintf(out, "#include <string.h>\n");
+    fprintf(out, "\nnamespace EM6502\n{\n");
+    fprintf(out, "  EXEC_RESULT %s(CPU& cpu, MEM& memory, s32 cycles)\n  {\n", name);
+    fprintf(out, "    const s32 CyclesRequested = cycles;\n");
+    fprintf(out, "    u32 Instructions = 0;\n");
+    fprintf(out, "    while (cycles > cpu.interrupt_deadline || cpu.take_interrupt(cycles, memory))\n    {\n");
+    fprintf(out, "      switch (cpu.PC)\n      {\n");
+    for (auto it = code.begin(); it != code.end(); ++it)
+    {
+      auto [Address, Info] = *it;
+      Word Next = Address + instruction_size(Info->mode);
+      auto NextIt = std::next(it);
+      bool FallsThrough = Info->flow == flow_types::NEXT && NextIt != code.end() && NextIt->first == Next;
+
+      // MEM has no write protection, so an opcode overwritten since the trace goes to the interpreter. The
+      // handlers read their operands at run time, so modified operands need no check.
+      fprintf(out, "        case 0x%04X:\n", Address);
+      fprintf(out, "          if (memory.Data[0x%04X] != 0x%02X) goto Interpret;\n", Address, memory[Address]);
+      fprintf(out, "          cpu.PC++; cycles--;\n");
+      fprintf(out, "          %s(&cpu, cycles, &memory);\n", Info->name);
+      fprintf(out, "          Instructions++;\n");
+      if (FallsThrough)
+        fprintf(out, "          if (cycles <= cpu.interrupt_deadline) break;\n");
+      else
+        fprintf(out, "          continue;\n");
+    }
+    fprintf(out, "        default:\n");
+    if (!code.empty())
+      fprintf(out, "        Interpret:\n");
+    fprintf(out, "          EXEC_RESULT Step = cpu.exec(1, memory);\n");
+    fprintf(out, "          cycles -= Step.cycles;\n");
+    fprintf(out, "          Instructions += Step.instructions;\n");
+    fprintf(out, "          if (Step.reason != halt_reasons::BUDGET_EXHAUSTED)\n");
+    fprintf(out, "            return { CyclesRequested - cycles, Instructions, Step.reason, Step.address };\n");
+    fprintf(out, "      }\n    }\n");
+    fprintf(out, "    return { CyclesRequested - cycles, Instructions, halt_reasons::BUDGET_EXHAUSTED, 0 };\n  }\n}\n");
+
+    if (!with_main)
+      return;
+
+    fprintf(out, "\nstatic const EM6502::Byte Rom[] = {");
+    for (u32 i = 0; i < rom_size; i++)
+      fprintf(out, "%s0x%02X,", (i % 16) ? " " : "\n  ", memory[rom_start + i]);
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "int main(int argc, char** argv)\n{\n");
+    fprintf(out, "  using namespace EM6502;\n");
+    fprintf(out, "  static MEM memory;\n");
+    fprintf(out, "  CPU cpu;\n");
+    fprintf(out, "  cpu.reset(memory);\n");
+    fprintf(out, "  memcpy(memory.Data + 0x%04X, Rom, sizeof(Rom));\n", rom_start);
+    fprintf(out, "  cpu.PC = 0x%04X;\n", entries.empty() ? rom_start : entries.front());
+    fprintf(out, "  s32 cycles = argc > 1 ? atoi(argv[1]) : 1000000;\n");
+    fprintf(out, "  EXEC_RESULT result = %s(cpu, memory, cycles);\n", name);
+    fprintf(out, "  printf(\"cycles=%%d instructions=%%u halt=%%d PC=%%04X SP=%%02X A=%%02X X=%%02X Y=%%02X P=%%02X\\n\",\n");
+    fprintf(out, "         result.cycles, result.instructions, (int)result.reason, cpu.PC, cpu.SP, cpu.A, cpu.X, cpu.Y, cpu.status());\n");
+    fprintf(out, "  return 0;\n}\n");
+  }
+
+  int recompile_command(int argc, char** argv)
+  {
+    if (argc < 3)
+    {
+      fprintf(stderr, "usage: emulator recompile <rom> <load address> <entry>[,<entry>...] [output.cpp] [--main]\n"
+                      "build the output with: g++ -std=c++20 -Iinclude output.cpp src/instruction_set.cpp src/breakpoints.cpp src/bus.cpp\n");
+      return 1;
+    }
+
+    static MEM memory;
+    memory.initialize();
+    u32 LoadAddress;
+    if (!parse_number(argv[1], LoadAddress) || LoadAddress >= MAX_MEM)
+    {
+      fprintf(stderr, "invalid load address: %s\n", argv[1]);
+      return 1;
+    }
+
+    RECOMPILER recompiler;
+    recompiler.rom_start = LoadAddress;
+    recompiler.rom_size = memory.load_program(argv[0], LoadAddress);
+    if (!recompiler.rom_size)
+    {
+      fprintf(stderr, "can't load %s at $%04X\n", argv[0], LoadAddress);
+      return 1;
+    }
+
+    for (char* Entry = strtok(argv[2], ","); Entry; Entry = strtok(nullptr, ","))
+    {
+      u32 Address;
+      if (!parse_number(Entry, Address) || Address >= MAX_MEM)
+      {
+        fprintf(stderr, "invalid entry point: %s\n", Entry);
+        return 1;
+      }
+      recompiler.entries.push_back(Address);
+    }
+
+    const char* OutputPath = nullptr;
+    bool WithMain = false;
+    for (int i = 3; i < argc; i++)
+    {
+      if (strcmp(argv[i], "--main") == 0)
+        WithMain = true;
+      else
+        OutputPath = argv[i];
+    }
+
+    FILE* out = OutputPath ? fopen(OutputPath, "w") : stdout;
+    if (!out)
+    {
+      fprintf(stderr, "can't write %s\n", OutputPath);
+      return 1;
+    }
+
+    recompiler.trace(memory);
+    recompiler.emit(out, memory, "run_recompiled", WithMain);
+    fprintf(stderr, "%zu instructions recompiled\n", recompiler.code.size());
+
+    if (out != stdout)
+      fclose(out);
+    return 0;
+  }
+}
\ No newline at end of file
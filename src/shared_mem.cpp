@@ -0,0 +1,202 @@
+#include "../include/shared_mem.h"
+#include <string.h>
+#include <new>
+#include <algorithm>
+#include <csignal>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define EM6502_HAS_SHM 1
+#endif
+
+namespace EM6502
+{
+  static volatile std::sig_atomic_t StopSharing = 0;
+
+  bool SHARED_MEM::create(const char* name)
+  {
+#ifdef EM6502_HAS_SHM
+    close();
+    shm_unlink(name);
+    int Fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (Fd < 0)
+      return false;
+    if (ftruncate(Fd, SIZE) != 0)
+    {
+      ::close(Fd);
+      shm_unlink(name);
+      return false;
+    }
+    void* Mapping = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+    ::close(Fd);
+    if (Mapping == MAP_FAILED)
+    {
+      shm_unlink(name);
+      return false;
+    }
+
+    base = (Byte*)Mapping;
+    owner = true;
+    strncpy(this->name, name, sizeof(this->name) - 1);
+    SHARED_HEADER* Header = new (base) SHARED_HEADER{};
+    new (base + MEMORY_OFFSET) MEM;
+    Header->magic = MAGIC;
+    Header->version = VERSION;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool SHARED_MEM::open(const char* name)
+  {
+#ifdef EM6502_HAS_SHM
+    close();
+    int Fd = shm_open(name, O_RDONLY, 0);
+    if (Fd < 0)
+      return false;
+    struct stat Stat;
+    if (fstat(Fd, &Stat) != 0 || (size_t)Stat.st_size < SIZE)
+    {
+      ::close(Fd);
+      return false;
+    }
+    void* Mapping = mmap(nullptr, SIZE, PROT_READ, MAP_SHARED, Fd, 0);
+    ::close(Fd);
+    if (Mapping == MAP_FAILED)
+      return false;
+
+    base = (Byte*)Mapping;
+    owner = false;
+    if (header().magic != MAGIC || header().version != VERSION)
+    {
+      close();
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void SHARED_MEM::close()
+  {
+#ifdef EM6502_HAS_SHM
+    if (!base)
+      return;
+    munmap(base, SIZE);
+    if (owner)
+      shm_unlink(name);
+    base = nullptr;
+    owner = false;
+#endif
+  }
+
+  bool SHARED_MEM::snapshot(REGISTERS& registers, u64& cycles, Byte* image, u32 max_attempts) const
+  {
+    const SHARED_HEADER& Header = header();
+    for (u32 Attempt = 0; Attempt < max_attempts; Attempt++)
+    {
+      u32 Before = Header.sequence.load(std::memory_order_acquire);
+      if (Before & 1)
+        continue;
+      registers = Header.registers;
+      cycles = Header.cycles;
+      if (image)
+        memcpy(image, base + PUBLISHED_OFFSET, MAX_MEM);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (Header.sequence.load(std::memory_order_relaxed) == Before)
+        return true;
+    }
+    return false;
+  }
+
+  int share_command(int argc, char** argv)
+  {
+    u32 LoadAddress, Entry, Slice = 10000;
+    if (argc < 4 || !parse_number(argv[2], LoadAddress) || LoadAddress >= MAX_MEM ||
+        !parse_number(argv[3], Entry) || Entry >= MAX_MEM ||
+        (argc > 4 && (!parse_number(argv[4], Slice) || Slice == 0 || Slice > 0x7FFFFFFF)))
+    {
+      fprintf(stderr, "usage: emulator share <name> <program> <load address> <entry> [slice cycles]\n"
+                      "runs the program until it halts, publishing its state after every slice\n");
+      return 1;
+    }
+
+    SHARED_MEM Shared;
+    if (!Shared.create(argv[0]))
+    {
+      fprintf(stderr, "can't create shared memory %s\n", argv[0]);
+      return 1;
+    }
+    MEM& memory = Shared.memory();
+    CPU cpu;
+    cpu.reset(memory);
+    if (!memory.load_program(argv[1], LoadAddress))
+    {
+      fprintf(stderr, "can't load %s at $%04X\n", argv[1], LoadAddress);
+      return 1;
+    }
+    cpu.PC = Entry;
+
+    // Leave the loop on Ctrl+C so the segment gets removed
+    std::signal(SIGINT, [](int) { StopSharing = 1; });
+    std::signal(SIGTERM, [](int) { StopSharing = 1; });
+
+    u64 Cycles = 0;
+    EXEC_RESULT Result;
+    do
+    {
+      Result = cpu.exec(Slice, memory);
+      Cycles += Result.cycles;
+      Shared.publish(cpu, Cycles);
+    } while (Result.reason == halt_reasons::BUDGET_EXHAUSTED && !StopSharing);
+
+    if (StopSharing)
+      printf("stopped at $%04X after %llu cycles\n", cpu.PC, Cycles);
+    else
+      printf("halted with reason %d at $%04X after %llu cycles\n", (int)Result.reason, Result.address, Cycles);
+    return 0;
+  }
+
+  int monitor_command(int argc, char** argv)
+  {
+    u32 Address = 0, Length = 256;
+    if (argc < 1 || (argc > 1 && (!parse_number(argv[1], Address) || Address >= MAX_MEM)) ||
+        (argc > 2 && !parse_number(argv[2], Length)))
+    {
+      fprintf(stderr, "usage: emulator monitor <name> [address] [length]\n");
+      return 1;
+    }
+
+    SHARED_MEM Shared;
+    if (!Shared.open(argv[0]))
+    {
+      fprintf(stderr, "can't open shared memory %s\n", argv[0]);
+      return 1;
+    }
+    static Byte Image[MAX_MEM];
+    REGISTERS Registers;
+    u64 Cycles;
+    if (!Shared.snapshot(Registers, Cycles, Image))
+    {
+      fprintf(stderr, "no consistent snapshot, the emulator slices may be too long\n");
+      return 1;
+    }
+
+    printf("cycles=%llu PC=%04X SP=%02X A=%02X X=%02X Y=%02X P=%02X\n", Cycles, Registers.PC, Registers.SP,
+           Registers.A, Registers.X, Registers.Y, Registers.P);
+    Length = std::min(Length, MAX_MEM - Address);
+    for (u32 i = 0; i < Length; i++)
+    {
+      if (i % 16 == 0)
+        printf("%s%04X:", i ? "\n" : "", Address + i);
+      printf(" %02X", Image[Address + i]);
+    }
+    printf("\n");
+    return 0;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "../include/test_matrix.h"
+#include <chrono>
+#include <string.h>
+
+namespace EM6502
+{
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr Word CODE_ADDRESS = 0x0200;    // Below every operand address of the matrix
+
+  static const MATRIX_OPERATION Operations[] = {
+    { "LDA", matrix_targets::A, false },
+    { "LDX", matrix_targets::X, false },
+    { "LDY", matrix_targets::Y, false },
+    { "LAX", matrix_targets::AX, false },
+    { "SAX", matrix_targets::NONE, true },
+    { "NOP", matrix_targets::NONE, false },
+  };
+
+  // Edge cases of each dimension
+  static const std::vector<Word> Values = { 0x00, 0x01, 0x37, 0x7F, 0x80, 0xFF };          // Zero, positive and negative
+  static const std::vector<Word> Indexes = { 0x00, 0x05, 0x10, 0xFF };
+  static const std::vector<Word> Flags = { 0x00, 0xFF };
+  static const std::vector<Word> ZeroPageOperands = { 0x42, 0x80, 0xFF };                   // $80 + $FF wraps to $7F
+  static const std::vector<Word> AbsoluteOperands = { 0x4402, 0x44F0, 0xFFF0 };             // $FFF0 + $10 wraps to $0000
+  static const std::vector<Word> PointerOperands = { 0x20, 0xFF };                          // A pointer at $FF ends at $00
+  static const std::vector<Word> Pointers = { 0x8034, 0x80F0 };
+  static const std::vector<Word> None = { 0x00 };
+
+  static constexpr Byte FILLER = 0xA5;        // Registers the instruction shouldn't touch
+  static constexpr Byte STORE_MASK = 0xC3;    // X of stores not indexed by X, so that A & X isn't A
+
+  static const MATRIX_OPERATION* find_operation(const char* name)
+  {
+    for (const MATRIX_OPERATION& Operation : Operations)
+    {
+      size_t Length = strlen(Operation.mnemonic);
+      if (strncmp(name, Operation.mnemonic, Length) == 0 && (name[Length] == '\0' || name[Length] == '_'))
+        return &Operation;
+    }
+    return nullptr;
+  }
+
+  static bool indexed_by_x(addressing_modes mode)
+  {
+    return mode == addressing_modes::ZPX || mode == addressing_modes::ABSX || mode == addressing_modes::INDX;
+  }
+
+  static bool indexed_by_y(addressing_modes mode)
+  {
+    return mode == addressing_modes::ZPY || mode == addressing_modes::ABSY || mode == addressing_modes::INDY;
+  }
+
+  /** Zero page address of the pointer used by the indirect modes */
+  static Byte pointer_location(const MATRIX_CASE& test_case)
+  {
+    if (test_case.info->mode == addressing_modes::INDX)
+      return test_case.operand + test_case.registers.X;
+    return test_case.operand;
+  }
+
+  /** Address of the operand as a 6502 computes it, independently of the handlers */
+  static Word effective_address(const MATRIX_CASE& test_case, bool& crossed)
+  {
+    const REGISTERS& Registers = test_case.registers;
+    Word Base = test_case.operand;
+    Word Index = 0;
+    switch (test_case.info->mode)
+    {
+      case addressing_modes::ZPX:
+        return (Byte)(test_case.operand + Registers.X);
+      case addressing_modes::ZPY:
+        return (Byte)(test_case.operand + Registers.Y);
+      case addressing_modes::ABSX:
+        Index = Registers.X;
+        break;
+      case addressing_modes::ABSY:
+        Index = Registers.Y;
+        break;
+      case addressing_modes::INDX:
+        return test_case.pointer;
+      case addressing_modes::INDY:
+        Base = test_case.pointer;
+        Index = Registers.Y;
+        break;
+      default:
+        break;
+    }
+    Word Address = Base + Index;
+    crossed = (Address >> 8) != (Base >> 8);
+    return Address;
+  }
+
+  std::string MATRIX_CASE::describe() const
+  {
+    char Line[160];
+    int Length = snprintf(Line, sizeof(Line), "%s", info->name);
+    Byte Size = instruction_size(info->mode);
+    if (Size == 2)
+      Length += snprintf(Line + Length, sizeof(Line) - Length, " $%02X", operand);
+    else if (Size == 3)
+      Length += snprintf(Line + Length, sizeof(Line) - Length, " $%04X", operand);
+    if (info->mode == addressing_modes::INDX || info->mode == addressing_modes::INDY)
+      Length += snprintf(Line + Length, sizeof(Line) - Length, " -> $%04X", pointer);
+    if (info->mode != addressing_modes::IMP && info->mode != addressing_modes::IM && !operation->stores_ax)
+      Length += snprintf(Line + Length, sizeof(Line) - Length, " = $%02X", value);
+    snprintf(Line + Length, sizeof(Line) - Length, " (opcode $%02X, A=$%02X X=$%02X Y=$%02X P=$%02X)", opcode,
+             registers.A, registers.X, registers.Y, registers.P);
+    return Line;
+  }
+
+  std::vector<MATRIX_CASE> generate_matrix()
+  {
+    std::vector<MATRIX_CASE> Cases;
+    for (u32 Opcode = 0; Opcode < 0x100; Opcode++)
+    {
+      const INSTRUCTION_INFO* Info = instruction_info(Opcode);
+      bool Undocumented = !Info;
+      if (!Info)
+        Info = undocumented_instruction_info(Opcode);
+      const MATRIX_OPERATION* Operation = Info ? find_operation(Info->name) : nullptr;
+      if (!Operation)
+        continue;
+
+      addressing_modes Mode = Info->mode;
+      const std::vector<Word>* Operands = &None;
+      const std::vector<Word>* Targets = &None;
+      const std::vector<Word>* OperandValues = Mode == addressing_modes::IMP ? &None : &Values;
+      switch (Mode)
+      {
+        case addressing_modes::ZP:
+        case addressing_modes::ZPX:
+        case addressing_modes::ZPY:
+          Operands = &ZeroPageOperands;
+          break;
+        case addressing_modes::ABS:
+        case addressing_modes::ABSX:
+        case addressing_modes::ABSY:
+          Operands = &AbsoluteOperands;
+          break;
+        case addressing_modes::INDX:
+        case addressing_modes::INDY:
+          Operands = &PointerOperands;
+          Targets = &Pointers;
+          break;
+        default:
+          break;
+      }
+      const std::vector<Word>& IndexValues = indexed_by_x(Mode) || indexed_by_y(Mode) ? Indexes : None;
+
+      for (Word Operand : *Operands)
+        for (Word Pointer : *Targets)
+          for (Word Index : IndexValues)
+            for (Word Value : *OperandValues)
+              for (Word P : Flags)
+              {
+                MATRIX_CASE Case{ (Byte)Opcode, Info, Operation, Undocumented, Operand, Pointer, (Byte)Value,
+                                  { CODE_ADDRESS, 0xFD, FILLER, FILLER, FILLER, (Byte)P } };
+                if (Mode == addressing_modes::IM)
+                  Case.operand = Value;
+                if (Operation->stores_ax)
+                {
+                  Case.registers.A = Value;
+                  Case.registers.X = STORE_MASK;
+                }
+                if (indexed_by_x(Mode))
+                  Case.registers.X = Index;
+                if (indexed_by_y(Mode))
+                  Case.registers.Y = Index;
+                Cases.push_back(Case);
+              }
+    }
+    return Cases;
+  }
+
+  bool run_matrix_case(TEST_FIXTURE& fixture, const MATRIX_CASE& test_case, std::string* failure)
+  {
+    CPU& Cpu = fixture.cpu;
+    const INSTRUCTION_INFO& Info = *test_case.info;
+    const REGISTERS& Registers = test_case.registers;
+
+    fixture.reset();
+    Cpu.illegal_opcode_policy = test_case.undocumented ? illegal_opcode_policies::UNDOCUMENTED : illegal_opcode_policies::HALT;
+    Cpu.set_registers(Registers);
+
+    Byte Size = instruction_size(Info.mode);
+    fixture.poke(CODE_ADDRESS, test_case.opcode);
+    if (Size > 1)
+      fixture.poke(CODE_ADDRESS + 1, test_case.operand & 0xFF);
+    if (Size > 2)
+      fixture.poke(CODE_ADDRESS + 2, test_case.operand >> 8);
+    if (Info.mode == addressing_modes::INDX || Info.mode == addressing_modes::INDY)
+    {
+      Byte Location = pointer_location(test_case);
+      fixture.poke(Location, test_case.pointer & 0xFF);
+      fixture.poke((Byte)(Location + 1), test_case.pointer >> 8);
+    }
+    bool Crossed = false;
+    Word Address = effective_address(test_case, Crossed);
+    bool Memory = Info.mode != addressing_modes::IMP && Info.mode != addressing_modes::IM;
+    Byte Stored = Registers.A & Registers.X;
+    if (Memory)
+      fixture.poke(Address, test_case.operation->stores_ax ? (Byte)~Stored : test_case.value);
+
+    EXEC_RESULT Result = Cpu.exec(1, fixture.memory);
+
+    REGISTERS Expected = Registers;
+    Expected.PC = CODE_ADDRESS + Size;
+    Expected.P |= 0x20;
+    Byte Loads = (Byte)test_case.operation->loads;
+    if (Loads & (Byte)matrix_targets::A)
+      Expected.A = test_case.value;
+    if (Loads & (Byte)matrix_targets::X)
+      Expected.X = test_case.value;
+    if (Loads & (Byte)matrix_targets::Y)
+      Expected.Y = test_case.value;
+    if (Loads)
+      Expected.P = (Expected.P & 0x7D) | (test_case.value == 0 ? 0x02 : 0) | (test_case.value & 0x80);
+    s32 ExpectedCycles = Info.cycles + (Info.page_penalty && Crossed ? 1 : 0);
+    Byte ExpectedMemory = test_case.operation->stores_ax ? Stored : test_case.value;
+
+    REGISTERS Actual = Cpu.registers();
+    bool Passed = Result.instructions == 1 && Result.reason == halt_reasons::BUDGET_EXHAUSTED &&
+                  Result.cycles == ExpectedCycles && Actual.PC == Expected.PC && Actual.SP == Expected.SP &&
+                  Actual.A == Expected.A && Actual.X == Expected.X && Actual.Y == Expected.Y &&
+                  Actual.P == Expected.P && (!Memory || fixture.memory[Address] == ExpectedMemory);
+    if (!Passed && failure)
+    {
+      char Line[256];
+      snprintf(Line, sizeof(Line),
+               "expected %d cycles PC=$%04X A=$%02X X=$%02X Y=$%02X P=$%02X [$%04X]=$%02X, "
+               "got %d cycles (%u instructions, %s) PC=$%04X A=$%02X X=$%02X Y=$%02X P=$%02X [$%04X]=$%02X",
+               ExpectedCycles, Expected.PC, Expected.A, Expected.X, Expected.Y, Expected.P, Address, ExpectedMemory,
+               Result.cycles, Result.instructions, halt_reason_name(Result.reason), Actual.PC, Actual.A, Actual.X,
+               Actual.Y, Actual.P, Address, fixture.memory[Address]);
+      *failure = Line;
+    }
+    return Passed;
+  }
+
+  u32 run_test_matrix(CPU& cpu, MEM& memory, FILE* out)
+  {
+    auto Start = Clock::now();
+    cpu.reset(memory);
+    TEST_FIXTURE Fixture(cpu, memory);
+    std::vector<MATRIX_CASE> Cases = generate_matrix();
+    u32 Failed = 0;
+    std::string Failure;
+    for (const MATRIX_CASE& Case : Cases)
+    {
+      if (run_matrix_case(Fixture, Case, &Failure))
+        continue;
+      fprintf(out, "%s - TEST FAILED\n  %s\n", Case.describe().c_str(), Failure.c_str());
+      Failed++;
+    }
+    Fixture.reset();
+    double Milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+    fprintf(out, "matrix: %zu cases, %u failed in %.1f ms\n", Cases.size(), Failed, Milliseconds);
+    return Failed;
+  }
+}
\ No newline at end of file
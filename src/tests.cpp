@@ -1,5 +1,17 @@
 #include "../include/tests.h"
+#include "../include/fusion.h"
+#include "../include/timeline.h"
+#include "../include/shared_mem.h"
+#include "../include/profiler.h"
+#include "../include/job_server.h"
+#include "../include/fuzzer.h"
+#include "../include/wcet.h"
+#include "../include/recompiler.h"
+#include "../include/pacer.h"
 #include <iostream>
+#include <string>
+#include <string.h>
+#include <unistd.h>
 
 namespace EM6502
 {
@@ -36,7 +48,7 @@ namespace EM6502
     	constexpr s32 NUM_CYCLES = 0;
 
     	//when:
-    	auto cycles_used = cpu.exec(NUM_CYCLES, memory);
+    	auto cycles_used = cpu.exec(NUM_CYCLES, memory).cycles;
 
     	//then:
     	return cycles_used == 0;
@@ -50,7 +62,7 @@ namespace EM6502
     	constexpr s32 NUM_CYCLES = 1;
 
     	// when:
-    	auto cycles_used = cpu.exec(NUM_CYCLES, memory);
+    	auto cycles_used = cpu.exec(NUM_CYCLES, memory).cycles;
 
         // then:
         return cycles_used == 2;
@@ -64,7 +76,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -79,7 +91,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -95,7 +107,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(3, memory);
+        auto cycles_used = cpu.exec(3, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -113,7 +125,7 @@ namespace EM6502
         // when:
         CPU cpu_copy = cpu;
 
-        auto cycles_used = cpu.exec(4, memory);
+        auto cycles_used = cpu.exec(4, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -130,7 +142,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(4, memory);
+        auto cycles_used = cpu.exec(4, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -144,7 +156,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         return cpu_copy.PC == cpu.PC - 1 && cycles_used == 2;
@@ -161,7 +173,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -180,7 +192,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -199,7 +211,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -218,7 +230,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -237,7 +249,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -257,7 +269,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -277,7 +289,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -297,7 +309,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -312,7 +324,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -327,7 +339,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -343,7 +355,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(3, memory);
+        auto cycles_used = cpu.exec(3, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -360,7 +372,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(4, memory);
+        auto cycles_used = cpu.exec(4, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -378,7 +390,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -397,7 +409,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -416,7 +428,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -431,7 +443,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -446,7 +458,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(2, memory);
+        auto cycles_used = cpu.exec(2, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -462,7 +474,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(3, memory);
+        auto cycles_used = cpu.exec(3, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -479,7 +491,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(4, memory);
+        auto cycles_used = cpu.exec(4, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -497,7 +509,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -516,7 +528,7 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
@@ -535,13 +547,632 @@ namespace EM6502
 
         // when:
         CPU cpu_copy = cpu;
-        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory);
+        auto cycles_used = cpu.exec(EXPECTED_CYCLES, memory).cycles;
 
         // then:
         bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
         return cpu.Y == 0x37 && !cpu.Z && !cpu.N && flags && cycles_used == EXPECTED_CYCLES;
     };
 
+    // Test that determines if fused handlers use the same cycles and set the same registers as unfused execution
+    static TEST FUSED_SEQUENCE_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        memory[0xFFFD] = 0x84;
+        memory[0xFFFE] = (Byte)opcodes::INS_LDX_IM;
+        memory[0xFFFF] = 0x00;
+        memory[0x0000] = (Byte)opcodes::INS_LDY_IM;
+        memory[0x0001] = 0x37;
+        CPU cpu_fused = cpu;
+        FUSION_PROFILE profile;
+        cpu_fused.exec_profiled(6, memory, profile);
+        cpu_fused = cpu;
+        u32 selected = cpu_fused.select_fused(profile, 8);
+
+        // when:
+        auto cycles_used = cpu.exec(6, memory).cycles;
+        auto cycles_used_fused = cpu_fused.exec(6, memory).cycles;
+
+        // then:
+        return selected > 0 && cycles_used == cycles_used_fused && cpu.PC == cpu_fused.PC &&
+            cpu_fused.A == 0x84 && cpu_fused.X == 0x00 && cpu_fused.Y == 0x37 && !cpu_fused.Z && !cpu_fused.N;
+    };
+
+    // Test that determines if a fused handler stops between instructions when the cycles run out
+    static TEST FUSED_SEQUENCE_LESS_CYCLES_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        memory[0xFFFD] = 0x84;
+        memory[0xFFFE] = (Byte)opcodes::INS_LDX_IM;
+        memory[0xFFFF] = 0x37;
+        FUSION_PROFILE profile;
+        profile.pairs[(Byte)opcodes::INS_LDA_IM | ((Byte)opcodes::INS_LDX_IM << 8)] = 1;
+        cpu.select_fused(profile, 1);
+
+        // when:
+        auto cycles_used = cpu.exec(1, memory).cycles;
+
+        // then:
+        return cycles_used == 2 && cpu.A == 0x84 && cpu.X == 0 && cpu.PC == 0xFFFE;
+    };
+
+    // Test that determines if the CPU halts on an illegal opcode without executing it
+    static TEST ILLEGAL_OPCODE_HALT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        memory[0xFFFD] = 0x84;
+        memory[0xFFFE] = 0x02;
+
+        // when:
+        auto result = cpu.exec(10, memory);
+
+        // then:
+        return result.reason == halt_reasons::ILLEGAL_OPCODE && result.address == 0xFFFE && cpu.PC == 0xFFFE &&
+            result.cycles == 2 && result.instructions == 1 && cpu.A == 0x84;
+    };
+
+    // Test that determines if the CPU skips an illegal opcode as a NOP when asked to
+    static TEST ILLEGAL_OPCODE_NOP_TEST = [](CPU cpu, MEM memory){
+        // given:
+        cpu.illegal_opcode_policy = illegal_opcode_policies::NOP;
+        memory[0xFFFC] = 0x02;
+
+        // when:
+        auto result = cpu.exec(2, memory);
+
+        // then:
+        return result.reason == halt_reasons::BUDGET_EXHAUSTED && cpu.PC == 0xFFFD &&
+            result.cycles == 2 && result.instructions == 1;
+    };
+
+    // Test that determines if the undocumented LAX Zero Page loads a value into the A and X registers
+    static TEST LAX_ZP_UNDOCUMENTED_TEST = [](CPU cpu, MEM memory){
+        // given:
+        cpu.illegal_opcode_policy = illegal_opcode_policies::UNDOCUMENTED;
+        memory[0xFFFC] = (Byte)undocumented_opcodes::INS_LAX_ZP;
+        memory[0xFFFD] = 0x42;
+        memory[0x0042] = 0x84;
+
+        // when:
+        CPU cpu_copy = cpu;
+        auto result = cpu.exec(3, memory);
+
+        // then:
+        bool flags = VerfifyUnmodifiedFlagsFromLD(cpu, cpu_copy);
+        return cpu.A == 0x84 && cpu.X == 0x84 && !cpu.Z && cpu.N && flags && result.cycles == 3 &&
+            result.reason == halt_reasons::BUDGET_EXHAUSTED;
+    };
+
+    // Test that determines if the CPU halts on BRK
+    static TEST BRK_HALT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        cpu.illegal_opcode_policy = illegal_opcode_policies::NOP;
+        memory[0xFFFC] = (Byte)opcodes::INS_NOP;
+        memory[0xFFFD] = (Byte)opcodes::INS_BRK;
+
+        // when:
+        auto result = cpu.exec(10, memory);
+
+        // then:
+        return result.reason == halt_reasons::BRK && result.address == 0xFFFD && result.cycles == 2;
+    };
+
+    // Test that determines if the CPU halts before an instruction with a breakpoint and runs it when resumed
+    static TEST BREAKPOINT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        BREAKPOINTS breakpoints;
+        breakpoints.set_breakpoint(0xFFFE);
+        cpu.breakpoints = &breakpoints;
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        memory[0xFFFD] = 0x84;
+        memory[0xFFFE] = (Byte)opcodes::INS_LDX_IM;
+        memory[0xFFFF] = 0x37;
+
+        // when:
+        auto result = cpu.exec(10, memory);
+        auto resumed = cpu.exec(2, memory);
+
+        // then:
+        return result.reason == halt_reasons::BREAKPOINT && result.address == 0xFFFE && result.cycles == 2 &&
+            resumed.reason == halt_reasons::BUDGET_EXHAUSTED && resumed.cycles == 2 && cpu.X == 0x37;
+    };
+
+    // Test that determines if the CPU halts after an instruction reads an address with a watchpoint
+    static TEST WATCHPOINT_READ_TEST = [](CPU cpu, MEM memory){
+        // given:
+        BREAKPOINTS breakpoints;
+        breakpoints.set_watchpoint(0x4481, true, false);
+        cpu.breakpoints = &breakpoints;
+        cpu.Y = 1;
+        memory[0xFFFC] = (Byte)opcodes::INS_NOP;
+        memory[0xFFFD] = (Byte)opcodes::INS_LDA_ABSY;
+        memory[0xFFFE] = 0x80;
+        memory[0xFFFF] = 0x44;  //0x4480 + 0x0001
+        memory[0x4481] = 0x37;
+
+        // when:
+        auto result = cpu.exec(20, memory);
+
+        // then:
+        return result.reason == halt_reasons::WATCHPOINT && result.address == 0x4481 && result.cycles == 6 &&
+            result.instructions == 2 && cpu.A == 0x37;
+    };
+
+    // Test that determines if fused handlers are not used while breakpoints are armed
+    static TEST BREAKPOINT_FUSED_TEST = [](CPU cpu, MEM memory){
+        // given:
+        FUSION_PROFILE profile;
+        profile.pairs[(Byte)opcodes::INS_LDA_IM | ((Byte)opcodes::INS_LDX_IM << 8)] = 1;
+        cpu.select_fused(profile, 1);
+        BREAKPOINTS breakpoints;
+        breakpoints.set_breakpoint(0xFFFE);
+        cpu.breakpoints = &breakpoints;
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        memory[0xFFFD] = 0x84;
+        memory[0xFFFE] = (Byte)opcodes::INS_LDX_IM;
+        memory[0xFFFF] = 0x37;
+
+        // when:
+        auto result = cpu.exec(10, memory);
+
+        // then:
+        return result.reason == halt_reasons::BREAKPOINT && result.cycles == 2 && cpu.X == 0;
+    };
+
+    // Test that determines if the timeline goes back to an earlier cycle with the same registers and memory
+    static TEST TIMELINE_SEEK_TEST = [](CPU cpu, MEM memory){
+        // given:
+        cpu.illegal_opcode_policy = illegal_opcode_policies::UNDOCUMENTED;
+        cpu.PC = 0x0200;
+        cpu.X = 0xFF;
+        for (Word Address = 0x0200; Address < 0x0300; Address += 4)    // 5 cycles per block
+        {
+            memory[Address] = (Byte)opcodes::INS_LDA_IM;
+            memory[Address + 1] = (Byte)Address;
+            memory[Address + 2] = (Byte)undocumented_opcodes::INS_SAX_ZP;
+            memory[Address + 3] = 0x05;
+        }
+        TIMELINE timeline(cpu, memory, 20, 4, 1024 * 1024);
+        timeline.run(100);
+        CPU cpu_copy = cpu;
+        MEM memory_copy = memory;
+
+        // when:
+        timeline.run(200);
+        bool seeked = timeline.seek(100) && cpu.PC == cpu_copy.PC && cpu.A == cpu_copy.A &&
+            memcmp(memory.Data, memory_copy.Data, MAX_MEM) == 0;
+        bool stepped_back = timeline.reverse_step();
+
+        // then:
+        return seeked && stepped_back && timeline.cycle() == 97 && cpu.PC == cpu_copy.PC - 2 && memory[0x05] != cpu.A;
+    };
+
+    // Test that determines if a monitor gets the registers and memory published in shared memory
+    static TEST SHARED_MEM_SNAPSHOT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        SHARED_MEM shared, monitor;
+        std::string name = "/em6502_test_" + std::to_string(getpid());     // Test runs may overlap
+        if (!shared.create(name.c_str()))
+        {
+            printf("no shared memory on this system, skipping the snapshot test\n");
+            return true;
+        }
+        MEM& shared_memory = shared.memory();
+        shared_memory = memory;
+        shared_memory[0xFFFC] = (Byte)opcodes::INS_LDA_IM;
+        shared_memory[0xFFFD] = 0x84;
+
+        // when:
+        auto result = cpu.exec(2, shared_memory);
+        shared.publish(cpu, result.cycles);
+        shared_memory[0x0000] = 0x37;   // Not published yet
+        REGISTERS registers;
+        u64 cycles;
+        static Byte image[MAX_MEM];
+        bool opened = monitor.open(name.c_str());
+        bool consistent = opened && monitor.snapshot(registers, cycles, image);
+
+        // then:
+        return consistent && registers.A == 0x84 && registers.PC == 0xFFFE && cycles == 2 &&
+            image[0xFFFC] == (Byte)opcodes::INS_LDA_IM && image[0x0000] == 0 && monitor.memory()[0x0000] == 0x37;
+    };
+
+    // Test that determines if the profiler charges sampled cycles to the routine of PC and its callers
+    static TEST PROFILER_ROUTINES_TEST = [](CPU cpu, MEM memory){
+        // given:
+        SYMBOLS symbols;
+        symbols.labels[0x0200] = "main";
+        symbols.labels[0x0300] = "work";
+        cpu.PC = 0x0200;
+        memory[0x0200] = (Byte)opcodes::INS_LDA_IM;
+        memory[0x0201] = 0x84;
+        memory[0x0202] = (Byte)opcodes::INS_JSR;
+        memory[0x0203] = 0x00;
+        memory[0x0204] = 0x03;
+        for (Word Address = 0x0300; Address < 0x030A; Address++)
+            memory[Address] = (Byte)opcodes::INS_NOP;
+        PROFILER profiler(symbols, 2);
+
+        // when:
+        auto result = profiler.run(cpu, memory, 28);
+
+        // then:
+        return result.cycles == 28 && profiler.self[0x0200] == 2 && profiler.self[0x0300] == 26 &&
+            profiler.inclusive[0x0300] == 26 && profiler.stacks.size() == 2 && cpu.call_depth == 1;
+    };
+
+    // Test that determines if a batch job stops at its instruction limit and checks its end conditions
+    static TEST BATCH_JOB_TEST = [](CPU cpu, MEM memory){
+        // given:
+        BATCH_JOB job;
+        bool parsed = parse_job("program.bin $0200 $0200 instructions=2 reason=instruction_limit a=$84 x=$37 $0010=0", job);
+        cpu.PC = job.entry;
+        memory[0x0200] = (Byte)opcodes::INS_LDA_IM;
+        memory[0x0201] = 0x84;
+        memory[0x0202] = (Byte)opcodes::INS_LDX_IM;
+        memory[0x0203] = 0x37;
+        memory[0x0204] = (Byte)opcodes::INS_LDA_IM;
+        memory[0x0205] = 0x00;
+
+        // when:
+        auto result = execute_job(job, cpu, memory);
+
+        // then:
+        return parsed && job.expectations.size() == 4 && result.failed.empty() && result.instructions == 2 &&
+            result.cycles == 4 && cpu.PC == 0x0204;
+    };
+
+    // Test that determines if a server job starts from the pristine image with its patches applied
+    static TEST JOB_REQUEST_TEST = [](CPU cpu, MEM memory){
+        // given:
+        static MEM pristine;
+        pristine = memory;
+        pristine[0x0200] = (Byte)opcodes::INS_LDA_ZP;
+        pristine[0x0201] = 0x10;
+        pristine[0x0010] = 0x37;
+        memory[0x0010] = 0x55;  // Left by a previous job
+        JOB_REQUEST request;
+        bool parsed = parse_request("entry=$0200 patch=$0202:a284 return=pc,x", request);
+
+        // when:
+        auto reply = run_request(request, pristine, cpu, memory);
+
+        // then:
+        return parsed && cpu.A == 0x37 && cpu.X == 0x84 && reply ==
+            "{\"status\":\"ok\",\"reason\":\"brk\",\"cycles\":5,\"instructions\":2,\"pc\":516,\"x\":132}";
+    };
+
+    // Test that determines if the engines agree on random programs and a memory difference is found
+    static TEST FUZZ_ENGINES_TEST = [](CPU cpu, MEM memory){
+        // given:
+        FUZZ_MACHINE interpreter(engines::INTERPRETER, 1), fused(engines::FUSED, 2), checked(engines::CHECKED, 3);
+        bool differs = false;
+
+        // when:
+        for (u64 seed = 0; seed < 50; seed++)
+        {
+            FUZZ_CASE fuzz_case = FUZZ_CASE::random(seed, 16, seed % 2);
+            differs |= run_differs(interpreter, fused, fuzz_case, nullptr) || run_differs(interpreter, checked, fuzz_case, nullptr);
+        }
+        (*fused.memory)[0x1234]++;
+
+        // then:
+        return !differs && first_difference(*interpreter.memory, *fused.memory) == 0x1234;
+    };
+
+    // Test that determines if a measured run halts within the statically estimated cycles
+    static TEST WCET_CROSS_CHECK_TEST = [](CPU cpu, MEM memory){
+        // given:
+        const Byte rom[] = {
+            (Byte)opcodes::INS_LDA_ABSX, 0xF0, 0x12,    // $0200, may cross a page
+            (Byte)opcodes::INS_JSR, 0x00, 0x03,
+        };
+        const Byte subroutine[] = {
+            (Byte)opcodes::INS_LDX_IM, 0x20,            // $0300
+            (Byte)opcodes::INS_LDY_ABSX, 0x00, 0x12,    // Can't cross a page
+            (Byte)opcodes::INS_LDA_INDY, 0x10,
+            (Byte)opcodes::INS_BRK
+        };
+        memcpy(memory.Data + 0x0200, rom, sizeof(rom));
+        memcpy(memory.Data + 0x0300, subroutine, sizeof(subroutine));
+        WCET_ESTIMATOR estimator(memory, 0x0200, 0x0108);
+        cpu.PC = 0x0200;
+
+        // when:
+        const ROUTINE_BOUNDS& bounds = estimator.analyze(0x0200);
+        auto result = cpu.exec(100, memory);
+
+        // then:
+        return bounds.bounded() && !bounds.to_return.reachable && bounds.to_halt.best == 21 && bounds.to_halt.worst == 23 &&
+            estimator.routines[0x0300].to_halt.worst == 12 && result.reason == halt_reasons::BRK && result.cycles == 21;
+    };
+
+    struct BUS_RECORDER
+    {
+        std::vector<u64> cycles;
+        std::vector<BUS_CYCLE> accesses;
+    };
+
+    // Test that determines if the bus sees each cycle of an instruction in order, and none while its device sleeps
+    static TEST BUS_CYCLES_TEST = [](CPU cpu, MEM memory){
+        // given:
+        BUS_RECORDER recorder;
+        BUS bus;
+        BUS_DEVICE device{ [](void* context, u64 cycle, const BUS_CYCLE& access){
+            ((BUS_RECORDER*)context)->cycles.push_back(cycle);
+            ((BUS_RECORDER*)context)->accesses.push_back(access);
+        }, &recorder };
+        bus.attach(device);
+        cpu.bus = &bus;
+        cpu.X = 0x10;
+        memory[0xFFFC] = (Byte)opcodes::INS_LDA_ABSX;   // Crosses from $44F0 to $4500
+        memory[0xFFFD] = 0xF0;
+        memory[0xFFFE] = 0x44;
+        memory[0x4500] = 0x37;
+
+        // when:
+        auto stepped = cpu.exec(5, memory);
+        device.active = false;
+        device.wake_cycle = 7;     // Passed during the skipped run, woken by the next exec
+        cpu.PC = 0xFFFC;
+        auto skipped = cpu.exec(5, memory);
+        cpu.PC = 0xFFFC;
+        auto woken = cpu.exec(5, memory);
+
+        // then:
+        const BUS_CYCLE expected[] = {
+            { 0xFFFC, (Byte)opcodes::INS_LDA_ABSX, bus_cycle_types::OPCODE_FETCH },
+            { 0xFFFD, 0xF0, bus_cycle_types::OPERAND_FETCH },
+            { 0xFFFE, 0x44, bus_cycle_types::OPERAND_FETCH },
+            { 0x4400, 0x00, bus_cycle_types::DUMMY_READ },
+            { 0x4500, 0x37, bus_cycle_types::READ }
+        };
+        bool traced = recorder.accesses.size() == 10;
+        for (size_t i = 0; traced && i < recorder.accesses.size(); i++)
+        {
+            const BUS_CYCLE& access = recorder.accesses[i];
+            traced = access.address == expected[i % 5].address && access.data == expected[i % 5].data &&
+                access.type == expected[i % 5].type && recorder.cycles[i] == (i < 5 ? i : i + 5);
+        }
+        return traced && stepped.cycles == 5 && skipped.cycles == 5 && woken.cycles == 5 && bus.cycle == 15 &&
+            device.active && cpu.A == 0x37;
+    };
+
+    // Test that determines if JSR and RTS wrap the stack within page one and keep the shadow return stack in sync
+    static TEST JSR_RTS_TEST = [](CPU cpu, MEM memory){
+        // given:
+        cpu.PC = 0x0200;
+        cpu.SP = 0x00;
+        memory[0x0200] = (Byte)opcodes::INS_JSR;
+        memory[0x0201] = 0x00;
+        memory[0x0202] = 0x03;
+        memory[0x0300] = (Byte)opcodes::INS_RTS;
+
+        // when:
+        auto call = cpu.exec(6, memory);
+        Byte SPInside = cpu.SP;
+        s32 predicted = cpu.predicted_return();
+        auto ret = cpu.exec(6, memory);
+
+        // then:
+        return call.cycles == 6 && ret.cycles == 6 && memory[0x0100] == 0x02 && memory[0x01FF] == 0x02 &&
+            SPInside == 0xFE && predicted == 0x0203 && cpu.PC == 0x0203 && cpu.SP == 0x00 && cpu.call_depth == 0;
+    };
+
+    // Test that determines if pushed registers and flags are pulled back unchanged
+    static TEST STACK_PUSH_PULL_TEST = [](CPU cpu, MEM memory){
+        // given:
+        const Byte program[] = {
+            (Byte)opcodes::INS_PHA,
+            (Byte)opcodes::INS_PHP,
+            (Byte)opcodes::INS_LDA_IM, 0x00,
+            (Byte)opcodes::INS_PLP,
+            (Byte)opcodes::INS_PLA,
+            (Byte)opcodes::INS_TSX
+        };
+        memcpy(memory.Data + 0x0200, program, sizeof(program));
+        cpu.PC = 0x0200;
+        cpu.A = 0x84;
+        cpu.C = 1;
+        cpu.V = 1;
+
+        // when:
+        auto result = cpu.exec(18, memory);
+
+        // then:
+        return result.cycles == 18 && result.instructions == 6 && memory[0x01FD] == 0x84 && memory[0x01FC] == 0x75 &&
+            cpu.A == 0x84 && cpu.X == 0xFD && cpu.SP == 0xFD && cpu.C && cpu.V && cpu.I && !cpu.Z && cpu.N && !cpu.B;
+    };
+
+    // Test that determines if IRQ is taken while its line is held and I is clear, and NMI once per rising edge
+    static TEST IRQ_LEVEL_NMI_EDGE_TEST = [](CPU cpu, MEM memory){
+        // given:
+        const Byte program[] = {
+            (Byte)opcodes::INS_CLI,
+            (Byte)opcodes::INS_NOP,
+            (Byte)opcodes::INS_NOP
+        };
+        memcpy(memory.Data + 0x0200, program, sizeof(program));
+        memory[0x0300] = (Byte)opcodes::INS_RTI;    // IRQ handler
+        memory[0x0400] = (Byte)opcodes::INS_RTI;    // NMI handler
+        memory[CPU::IRQ_VECTOR] = 0x00;
+        memory[CPU::IRQ_VECTOR + 1] = 0x03;
+        memory[CPU::NMI_VECTOR] = 0x00;
+        memory[CPU::NMI_VECTOR + 1] = 0x04;
+        cpu.PC = 0x0200;
+
+        // when:
+        cpu.set_irq(true);
+        auto masked = cpu.exec(2, memory);          // CLI
+        auto entry = cpu.exec(7, memory);
+        Word Handler = cpu.PC;
+        u32 Pushed = (memory[0x01FD] << 16) | (memory[0x01FC] << 8) | memory[0x01FB];    // PC and flags
+        cpu.exec(6 + 7, memory);                    // RTI, entry again as the line is still held
+        Word Again = cpu.PC;
+        cpu.set_irq(false);
+        cpu.exec(6 + 2, memory);                    // RTI, NOP
+        Word Released = cpu.PC;
+        cpu.set_nmi(true);
+        auto nmi = cpu.exec(7 + 6 + 2, memory);     // Entry, RTI, NOP
+
+        // then:
+        return masked.instructions == 1 && entry.cycles == 7 && entry.instructions == 0 && Handler == 0x0300 &&
+            Pushed == 0x020120 && Again == 0x0300 &&
+            Released == 0x0202 && nmi.cycles == 15 && nmi.instructions == 2 && cpu.PC == 0x0203 && cpu.SP == 0xFD && !cpu.I;
+    };
+
+    // Test that determines if BRK runs as an interrupt with B set when it doesn't halt
+    static TEST BRK_INTERRUPT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memory[0x0200] = (Byte)opcodes::INS_BRK;
+        memory[0x0300] = (Byte)opcodes::INS_RTI;
+        memory[CPU::IRQ_VECTOR] = 0x00;
+        memory[CPU::IRQ_VECTOR + 1] = 0x03;
+        cpu.PC = 0x0200;
+        cpu.halt_on_brk = false;
+
+        // when:
+        auto result = cpu.exec(7 + 6, memory);
+
+        // then:
+        return result.cycles == 13 && result.instructions == 2 && result.reason == halt_reasons::BUDGET_EXHAUSTED &&
+            memory[0x01FB] == 0x34 && cpu.PC == 0x0202 && cpu.SP == 0xFD && cpu.call_depth == 0;
+    };
+
+    // Test that determines if going back before a JSR also pops its frame from the shadow call stack
+    static TEST TIMELINE_CALL_STACK_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memory[0x0200] = (Byte)opcodes::INS_NOP;
+        memory[0x0201] = (Byte)opcodes::INS_NOP;
+        memory[0x0202] = (Byte)opcodes::INS_JSR;    // At cycle 4
+        memory[0x0203] = 0x00;
+        memory[0x0204] = 0x03;
+        for (Word Address = 0x0300; Address < 0x0310; Address++)
+            memory[Address] = (Byte)opcodes::INS_NOP;
+        cpu.PC = 0x0200;
+        TIMELINE timeline(cpu, memory, 4, 4, 1024 * 1024);
+        timeline.run(20);
+        s32 predicted = cpu.predicted_return();
+
+        // when:
+        bool seeked = timeline.seek(2);
+        u32 depth = cpu.call_depth;
+        timeline.run(18);
+
+        // then:
+        return seeked && predicted == 0x0205 && depth == 0 && cpu.call_depth == 1 && cpu.predicted_return() == 0x0205;
+    };
+
+    // Test that determines if going back before a taken IRQ replays it from the lines held at the checkpoint
+    static TEST TIMELINE_IRQ_REPLAY_TEST = [](CPU cpu, MEM memory){
+        // given:
+        for (Word Address = 0x0200; Address < 0x0260; Address++)
+            memory[Address] = (Byte)opcodes::INS_NOP;
+        memory[0x0220] = (Byte)opcodes::INS_CLI;    // At cycle 64
+        for (Word Address = 0x0300; Address < 0x0340; Address++)
+            memory[Address] = (Byte)opcodes::INS_NOP;     // IRQ handler
+        memory[CPU::IRQ_VECTOR] = 0x00;
+        memory[CPU::IRQ_VECTOR + 1] = 0x03;
+        cpu.PC = 0x0200;
+        TIMELINE timeline(cpu, memory, 20, 4, 1024 * 1024);
+        timeline.run(20);
+        cpu.set_irq(true);      // Held across the checkpoint at cycle 40
+        timeline.run(100);
+        REGISTERS taken = cpu.registers();
+        u64 cycle = timeline.cycle();
+        cpu.set_irq(false);     // Acknowledged by the handler
+
+        // when:
+        bool seeked = timeline.seek(50);
+        timeline.run((s32)(cycle - 50));
+        REGISTERS replayed = cpu.registers();
+
+        // then:
+        return seeked && taken.PC >= 0x0300 && timeline.cycle() == cycle && replayed.PC == taken.PC &&
+            replayed.SP == taken.SP && replayed.A == taken.A && replayed.P == taken.P && cpu.irq_lines == 1;
+    };
+
+    // Test that determines if the recompiler traces through calls and its output runs like the interpreter, also
+    // when the code in the stack page overwrites itself
+    static TEST RECOMPILER_OUTPUT_TEST = [](CPU cpu, MEM memory){
+        // given:
+        const Byte rom[] = {
+            (Byte)opcodes::INS_LDX_IM, 0x8F,        // $0180
+            (Byte)opcodes::INS_TXS,
+            (Byte)opcodes::INS_LDA_IM, 0xA2,
+            (Byte)opcodes::INS_PHA,                 // $0185, turns the LDY at $018F into LDX
+            (Byte)opcodes::INS_JSR, 0x92, 0x01,     // $0186, its return address becomes the operand at $018D
+            (Byte)opcodes::INS_NOP,
+            (Byte)opcodes::INS_NOP,
+            (Byte)opcodes::INS_NOP,
+            (Byte)opcodes::INS_LDA_ABS, 0x00, 0x00, // $018C
+            (Byte)opcodes::INS_LDY_IM, 0x05,        // $018F
+            (Byte)opcodes::INS_BRK,                 // $0191, left to CPU::exec
+            (Byte)opcodes::INS_LDY_IM, 0x12,        // $0192
+            (Byte)opcodes::INS_RTS
+        };
+        memcpy(memory.Data + 0x0180, rom, sizeof(rom));
+        RECOMPILER recompiler;
+        recompiler.rom_start = 0x0180;
+        recompiler.rom_size = sizeof(rom);
+        recompiler.entries.push_back(0x0180);
+        cpu.PC = 0x0180;
+
+        // when:
+        recompiler.trace(memory);
+        std::string path = "/tmp/em6502_recompiled_" + std::to_string(getpid());
+        FILE* out = fopen((path + ".cpp").c_str(), "w");
+        if (out)
+        {
+            recompiler.emit(out, memory, "run_recompiled", true);
+            fclose(out);
+        }
+        auto result = cpu.exec(100, memory);
+        // Links with the objects of build.sh, so the tests must run from the repository root
+        std::string build = "g++ -std=c++20 -Iinclude " + path + ".cpp src/instruction_set.o src/breakpoints.o src/bus.o -o " +
+                            path + " 2>/dev/null";
+        bool built = out && system(build.c_str()) == 0;
+        int cycles = 0, halt = -1;
+        unsigned instructions = 0, pc = 0, sp = 0, a = 0, x = 0, y = 0, p = 0;
+        FILE* run = built ? popen((path + " 100").c_str(), "r") : nullptr;
+        bool ran = run && fscanf(run, "cycles=%d instructions=%u halt=%d PC=%x SP=%x A=%x X=%x Y=%x P=%x", &cycles,
+                                 &instructions, &halt, &pc, &sp, &a, &x, &y, &p) == 9;
+        if (run)
+            pclose(run);
+        remove((path + ".cpp").c_str());
+        remove(path.c_str());
+        if (!built)
+            printf("recompiler output not built, skipping its run\n");
+
+        // then:
+        bool traced = recompiler.code.size() == 12 && recompiler.code.count(0x0186) && recompiler.code.count(0x018F) &&
+            recompiler.code.count(0x0192) && recompiler.code.count(0x0194) && !recompiler.code.count(0x0191);
+        return traced && result.reason == halt_reasons::BRK && cpu.A == 0x01 && cpu.X == 0x05 && cpu.Y == 0x12 && (!built ||
+            (ran && cycles == result.cycles && instructions == result.instructions && halt == (int)result.reason &&
+             pc == cpu.PC && sp == cpu.SP && a == cpu.A && x == cpu.X && y == cpu.Y && p == cpu.status()));
+    };
+
+    // Test that determines if the pacer runs whole slices and accounts each wake up once
+    static TEST PACER_SLICES_TEST = [](CPU cpu, MEM memory){
+        // given:
+        memset(memory.Data, (Byte)opcodes::INS_NOP, MAX_MEM);
+        PACER pacer(10000000);      // 100 us per slice
+        pacer.slice_cycles = 1000;
+
+        // when:
+        auto start = PACER::Clock::now();
+        auto result = pacer.run(cpu, memory, 10000);
+        double elapsed_us = std::chrono::duration<double, std::micro>(PACER::Clock::now() - start).count();
+        u64 wake_ups = 0;
+        for (u64 count : pacer.jitter)
+            wake_ups += count;
+
+        // then:
+        return result.cycles == 10000 && result.reason == halt_reasons::BUDGET_EXHAUSTED && pacer.slices == 10 &&
+            wake_ups == 10 && pacer.late_slices <= 10 && pacer.resyncs == 0 && pacer.final_drift_us >= 0 &&
+            pacer.max_drift_us >= pacer.final_drift_us && elapsed_us >= 1000;
+    };
+
     void TESTS::InitializeTests()
   {
     tests.push_back(CPU_ZERO_CYCLES_TEST);
@@ -573,5 +1204,30 @@ namespace EM6502
     tests.push_back(LDY_ABS_TEST);
     tests.push_back(LDY_ABSX_TEST);
     tests.push_back(LDY_ABSX_CROSS_TEST);
+    tests.push_back(FUSED_SEQUENCE_TEST);
+    tests.push_back(FUSED_SEQUENCE_LESS_CYCLES_TEST);
+    tests.push_back(ILLEGAL_OPCODE_HALT_TEST);
+    tests.push_back(ILLEGAL_OPCODE_NOP_TEST);
+    tests.push_back(LAX_ZP_UNDOCUMENTED_TEST);
+    tests.push_back(BRK_HALT_TEST);
+    tests.push_back(BREAKPOINT_TEST);
+    tests.push_back(WATCHPOINT_READ_TEST);
+    tests.push_back(BREAKPOINT_FUSED_TEST);
+    tests.push_back(TIMELINE_SEEK_TEST);
+    tests.push_back(SHARED_MEM_SNAPSHOT_TEST);
+    tests.push_back(PROFILER_ROUTINES_TEST);
+    tests.push_back(BATCH_JOB_TEST);
+    tests.push_back(JOB_REQUEST_TEST);
+    tests.push_back(FUZZ_ENGINES_TEST);
+    tests.push_back(WCET_CROSS_CHECK_TEST);
+    tests.push_back(BUS_CYCLES_TEST);
+    tests.push_back(JSR_RTS_TEST);
+    tests.push_back(STACK_PUSH_PULL_TEST);
+    tests.push_back(IRQ_LEVEL_NMI_EDGE_TEST);
+    tests.push_back(BRK_INTERRUPT_TEST);
+    tests.push_back(TIMELINE_IRQ_REPLAY_TEST);
+    tests.push_back(TIMELINE_CALL_STACK_TEST);
+    tests.push_back(RECOMPILER_OUTPUT_TEST);
+    tests.push_back(PACER_SLICES_TEST);
   }
 }
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "../include/timeline.h"
+#include <string.h>
+#include <algorithm>
+#include <climits>
+
+namespace EM6502
+{
+  TIMELINE::TIMELINE(CPU& cpu, MEM& memory, u64 interval, u32 keyframe_every, size_t memory_budget)
+    : cpu(cpu), memory(memory), interval(interval), keyframe_every(keyframe_every ? keyframe_every : 1),
+      memory_budget(memory_budget), last_image(MAX_MEM)
+  {
+    checkpoint();
+  }
+
+  size_t TIMELINE::checkpoint_size(const CHECKPOINT& checkpoint) const
+  {
+    return sizeof(CHECKPOINT) + checkpoint.calls.size() * sizeof(CALL_FRAME) + checkpoint.image.size() +
+           checkpoint.pages.size() * sizeof(checkpoint.pages[0]);
+  }
+
+  void TIMELINE::checkpoint()
+  {
+    CHECKPOINT Checkpoint{ now, cpu.registers(), cpu.interrupt_lines(), cpu.call_depth,
+                           { cpu.call_stack, cpu.call_stack + std::min(cpu.call_depth, CPU::CALL_STACK_SIZE) }, false, {}, {} };
+    if (checkpoints.empty() || since_keyframe + 1 >= keyframe_every)
+    {
+      Checkpoint.keyframe = true;
+      Checkpoint.image.assign(memory.Data, memory.Data + MAX_MEM);
+      since_keyframe = 0;
+    }
+    else
+    {
+      for (u32 Page = 0; Page < MAX_MEM / 256; Page++)
+      {
+        const Byte* Data = memory.Data + Page * 256;
+        if (memcmp(Data, last_image.data() + Page * 256, 256) != 0)
+        {
+          Checkpoint.pages.emplace_back((Byte)Page, PAGE{});
+          memcpy(Checkpoint.pages.back().second.data(), Data, 256);
+        }
+      }
+      since_keyframe++;
+    }
+    memcpy(last_image.data(), memory.Data, MAX_MEM);
+    used += checkpoint_size(Checkpoint);
+    checkpoints.push_back(std::move(Checkpoint));
+
+    // Drop the oldest keyframe with its deltas, as long as another keyframe remains
+    while (used > memory_budget)
+    {
+      size_t NextKeyframe = 1;
+      while (NextKeyframe < checkpoints.size() && !checkpoints[NextKeyframe].keyframe)
+        NextKeyframe++;
+      if (NextKeyframe == checkpoints.size())
+        break;
+      for (size_t i = 0; i < NextKeyframe; i++)
+      {
+        used -= checkpoint_size(checkpoints.front());
+        checkpoints.pop_front();
+      }
+    }
+  }
+
+  void TIMELINE::reconstruct(size_t index, Byte* image) const
+  {
+    size_t Keyframe = index;
+    while (!checkpoints[Keyframe].keyframe)
+      Keyframe--;
+    memcpy(image, checkpoints[Keyframe].image.data(), MAX_MEM);
+    for (size_t i = Keyframe + 1; i <= index; i++)
+      for (auto& [Page, Data] : checkpoints[i].pages)
+        memcpy(image + Page * 256, Data.data(), 256);
+  }
+
+  void TIMELINE::restore_index(size_t index)
+  {
+    reconstruct(index, memory.Data);
+    cpu.set_registers(checkpoints[index].registers);
+    cpu.set_interrupt_lines(checkpoints[index].interrupts);
+    const std::vector<CALL_FRAME>& Calls = checkpoints[index].calls;
+    std::copy(Calls.begin(), Calls.end(), cpu.call_stack);
+    cpu.call_depth = checkpoints[index].call_depth;
+    now = checkpoints[index].cycle;
+  }
+
+  bool TIMELINE::restore(u64 cycle)
+  {
+    for (size_t i = checkpoints.size(); i-- > 0;)
+    {
+      if (checkpoints[i].cycle <= cycle)
+      {
+        restore_index(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  EXEC_RESULT TIMELINE::replay(u64 cycles)
+  {
+    BREAKPOINTS* Breakpoints = cpu.breakpoints;
+    cpu.breakpoints = nullptr;
+    EXEC_RESULT Result{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    u64 Target = now + cycles;
+    while (now < Target)
+    {
+      Result = cpu.exec((s32)std::min<u64>(Target - now, INT_MAX), memory);
+      now += Result.cycles;
+      if (Result.reason != halt_reasons::BUDGET_EXHAUSTED)
+        break;
+    }
+    cpu.breakpoints = Breakpoints;
+    return Result;
+  }
+
+  EXEC_RESULT TIMELINE::run(s32 cycles)
+  {
+    // Going back then forward starts a new history from here
+    if (checkpoints.back().cycle > now)
+    {
+      while (checkpoints.back().cycle > now)
+      {
+        used -= checkpoint_size(checkpoints.back());
+        checkpoints.pop_back();
+      }
+      reconstruct(checkpoints.size() - 1, last_image.data());
+      since_keyframe = 0;
+      for (size_t i = checkpoints.size() - 1; !checkpoints[i].keyframe; i--)
+        since_keyframe++;
+    }
+
+    EXEC_RESULT Total{ 0, 0, halt_reasons::BUDGET_EXHAUSTED, 0 };
+    const u64 Target = now + cycles;
+    while (now < Target)
+    {
+      u64 NextCheckpoint = checkpoints.back().cycle + interval;
+      EXEC_RESULT Result = cpu.exec((s32)(std::min(Target, NextCheckpoint) - now), memory);
+      now += Result.cycles;
+      Total.cycles += Result.cycles;
+      Total.instructions += Result.instructions;
+      if (now >= NextCheckpoint)
+        checkpoint();
+      if (Result.reason != halt_reasons::BUDGET_EXHAUSTED)
+      {
+        Total.reason = Result.reason;
+        Total.address = Result.address;
+        break;
+      }
+    }
+    return Total;
+  }
+
+  bool TIMELINE::seek(u64 cycle)
+  {
+    if (!restore(cycle))
+      return false;
+    if (cycle > now)
+      replay(cycle - now);
+    return true;
+  }
+
+  bool TIMELINE::reverse_step()
+  {
+    const u64 Original = now;
+    if (Original == 0 || !restore(Original - 1))
+      return false;
+
+    u64 Previous = now;
+    while (now < Original)
+    {
+      Previous = now;
+      if (replay(1).cycles == 0)
+        break;
+    }
+    return seek(Previous);
+  }
+
+  bool TIMELINE::reverse_continue()
+  {
+    const u64 Original = now;
+    if (!cpu.breakpoints || !cpu.breakpoints->armed())
+      return false;
+
+    for (size_t i = checkpoints.size(); i-- > 0;)
+    {
+      if (checkpoints[i].cycle >= Original)
+        continue;
+      u64 SegmentEnd = std::min(i + 1 < checkpoints.size() ? checkpoints[i + 1].cycle : Original, Original);
+
+      // The last breakpoint reached in this segment, if any
+      restore_index(i);
+      bool Found = false;
+      u64 Hit = 0;
+      while (now < SegmentEnd)
+      {
+        if (cpu.breakpoints->execute[cpu.PC])
+        {
+          Found = true;
+          Hit = now;
+        }
+        if (replay(1).cycles == 0)
+          break;
+      }
+      if (Found)
+      {
+        seek(Hit);
+        cpu.skip_breakpoint();
+        return true;
+      }
+    }
+    seek(Original);
+    return false;
+  }
+}
\ No newline at end of file
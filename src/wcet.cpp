@@ -0,0 +1,413 @@
+#include "../include/wcet.h"
+#include <algorithm>
+#include <string.h>
+
+namespace EM6502
+{
+  void CYCLE_BOUNDS::merge(const CYCLE_BOUNDS& other)
+  {
+    if (!other.reachable)
+      return;
+    best = reachable ? std::min(best, other.best) : other.best;
+    worst = reachable ? std::max(worst, other.worst) : other.worst;
+    reachable = true;
+  }
+
+  /** Paths of bounds followed by those of next */
+  static CYCLE_BOUNDS chain(const CYCLE_BOUNDS& bounds, const CYCLE_BOUNDS& next)
+  {
+    if (!bounds.reachable || !next.reachable)
+      return {};
+    return { true, bounds.best + next.best, bounds.worst + next.worst };
+  }
+
+  static std::string hex_address(const char* text, Word address)
+  {
+    char Text[64];
+    snprintf(Text, sizeof(Text), "%s $%04X", text, address);
+    return Text;
+  }
+
+  bool WCET_ESTIMATOR::read_bounds(FILE* file)
+  {
+    char Line[256];
+    while (fgets(Line, sizeof(Line), file))
+    {
+      char* Comment = strchr(Line, '#');
+      if (Comment)
+        *Comment = '\0';
+      char Header[64], Iterations[64];
+      int Fields = sscanf(Line, "%63s %63s", Header, Iterations);
+      if (Fields <= 0)
+        continue;
+      u32 Address, Count;
+      if (Fields != 2 || !parse_number(Header, Address) || Address >= MAX_MEM || !parse_number(Iterations, Count) || Count == 0)
+        return false;
+      loop_bounds[Address] = Count;
+    }
+    return true;
+  }
+
+  const INSTRUCTION_INFO* WCET_ESTIMATOR::decode(Word address) const
+  {
+    const INSTRUCTION_INFO* Info = instruction_info(memory[address]);
+    if (!Info && undocumented)
+      Info = undocumented_instruction_info(memory[address]);
+    // BRK ends the analysis like an unknown opcode, as CPU::halt_on_brk does by default
+    if (Info && Info->flow == flow_types::BREAK)
+      return nullptr;
+    return Info;
+  }
+
+  void WCET_ESTIMATOR::instruction_cycles(Word address, const INSTRUCTION_INFO& info, u32& best, u32& worst) const
+  {
+    best = worst = info.cycles;
+    if (!info.page_penalty)
+      return;
+    // X or Y can't carry a base address ending in $00 into the next page
+    bool Absolute = info.mode == addressing_modes::ABSX || info.mode == addressing_modes::ABSY;
+    if (!Absolute || memory[(Word)(address + 1)] != 0x00)
+      worst++;
+  }
+
+  bool WCET_ESTIMATOR::build_blocks(Word entry, std::map<Word, BASIC_BLOCK>& blocks, std::string& problem) const
+  {
+    // Leaders first, so that a block never starts inside another one
+    std::set<Word> Leaders{ entry };
+    std::set<Word> Visited;
+    std::vector<Word> Pending{ entry };
+    while (!Pending.empty())
+    {
+      Word Address = Pending.back();
+      Pending.pop_back();
+      while (true)
+      {
+        if (Visited.count(Address))
+        {
+          // Joins code already walked
+          Leaders.insert(Address);
+          break;
+        }
+        Visited.insert(Address);
+        const INSTRUCTION_INFO* Info = decode(Address);
+        if (!in_rom(Address) || (Info && !in_rom(Address + instruction_size(Info->mode) - 1)))
+        {
+          problem = hex_address("leaves the ROM at", Address);
+          return false;
+        }
+        if (!Info)
+          break;
+        Word Next = Address + instruction_size(Info->mode);
+        if (Info->flow == flow_types::RETURN)
+          break;
+        if (Info->flow == flow_types::CALL)
+        {
+          Leaders.insert(Next);
+          Pending.push_back(Next);
+          break;
+        }
+        Address = Next;
+      }
+    }
+
+    for (Word Leader : Leaders)
+    {
+      BASIC_BLOCK& Block = blocks[Leader];
+      Block.start = Leader;
+      Word Address = Leader;
+      while (true)
+      {
+        const INSTRUCTION_INFO* Info = decode(Address);
+        if (!Info)
+        {
+          Block.halts = true;
+          break;
+        }
+        u32 Best, Worst;
+        instruction_cycles(Address, *Info, Best, Worst);
+        Block.best += Best;
+        Block.worst += Worst;
+        Word Instruction = Address;
+        Address += instruction_size(Info->mode);
+        if (Info->flow == flow_types::CALL)
+        {
+          Block.call = memory[(Word)(Instruction + 1)] | (memory[(Word)(Instruction + 2)] << 8);
+          Block.successors.push_back(Address);
+          break;
+        }
+        if (Info->flow == flow_types::RETURN)
+        {
+          Block.returns = true;
+          break;
+        }
+        if (Leaders.count(Address))
+        {
+          Block.successors.push_back(Address);
+          break;
+        }
+      }
+      Block.end = Address;
+    }
+    return true;
+  }
+
+  const ROUTINE_BOUNDS& WCET_ESTIMATOR::analyze(Word entry)
+  {
+    auto Known = routines.find(entry);
+    if (Known != routines.end())
+      return Known->second;
+    ROUTINE_BOUNDS Bounds;
+    std::map<Word, BASIC_BLOCK> Blocks;
+    if (analyzing.count(entry))
+    {
+      Bounds.problem = hex_address("calls itself at", entry);
+      return routines[entry] = Bounds;
+    }
+    if (!build_blocks(entry, Blocks, Bounds.problem))
+      return routines[entry] = Bounds;
+
+    // Subroutines first, their bounds are part of the calling blocks
+    analyzing.insert(entry);
+    std::map<Word, const ROUTINE_BOUNDS*> Calls;
+    for (auto& [Start, Block] : Blocks)
+    {
+      if (Block.call < 0)
+        continue;
+      const ROUTINE_BOUNDS& Callee = analyze(Block.call);
+      if (!Callee.bounded() && Bounds.problem.empty())
+        Bounds.problem = hex_address("calls", Block.call) + " which " + Callee.problem;
+      Calls[Start] = &Callee;
+    }
+    analyzing.erase(entry);
+    if (!Bounds.bounded())
+      return routines[entry] = Bounds;
+
+    // Depth first search: the finishing order reversed is a topological order once back edges are removed
+    std::map<Word, Byte> State;     // 1 on the stack, 2 finished
+    std::vector<Word> Finished;
+    std::set<std::pair<Word, Word>> BackEdges;
+    std::vector<std::pair<Word, size_t>> Stack{ { entry, 0 } };
+    State[entry] = 1;
+    while (!Stack.empty())
+    {
+      auto& [Start, Index] = Stack.back();
+      const BASIC_BLOCK& Block = Blocks[Start];
+      bool Returns = Block.call < 0 || Calls[Start]->to_return.reachable;
+      if (Returns && Index < Block.successors.size())
+      {
+        Word Successor = Block.successors[Index++];
+        if (State[Successor] == 1)
+          BackEdges.insert({ Start, Successor });
+        else if (State[Successor] == 0)
+        {
+          State[Successor] = 1;
+          Stack.push_back({ Successor, 0 });
+        }
+        continue;
+      }
+      State[Start] = 2;
+      Finished.push_back(Start);
+      Stack.pop_back();
+    }
+
+    // Cycles of each block, the subroutine returning included, with loop headers weighted by their iterations
+    std::map<Word, CYCLE_BOUNDS> Weight;
+    for (Word Start : Finished)
+    {
+      const BASIC_BLOCK& Block = Blocks[Start];
+      Weight[Start] = { true, Block.best, Block.worst };
+      if (Block.call >= 0)
+        Weight[Start] = chain(Weight[Start], Calls[Start]->to_return);
+    }
+    auto forward = [&](Word from, Word to) { return !BackEdges.count({ from, to }); };
+
+    std::map<Word, std::vector<Word>> Loops;  // Header -> sources of its back edges
+    for (auto [From, To] : BackEdges)
+      Loops[To].push_back(From);
+    std::vector<std::pair<size_t, Word>> Headers;
+    std::map<Word, std::set<Word>> Bodies;
+    for (auto& [Header, Sources] : Loops)
+    {
+      if (!loop_bounds.count(Header))
+      {
+        Bounds.problem = hex_address("has a loop without a bound at", Header);
+        return routines[entry] = Bounds;
+      }
+      // Blocks reaching a back edge without going through the header
+      std::set<Word>& Body = Bodies[Header];
+      Body.insert(Header);
+      std::vector<Word> Walk(Sources.begin(), Sources.end());
+      while (!Walk.empty())
+      {
+        Word Start = Walk.back();
+        Walk.pop_back();
+        if (!Body.insert(Start).second)
+          continue;
+        for (Word Other : Finished)
+          for (Word Successor : Blocks[Other].successors)
+            if (Successor == Start && forward(Other, Start))
+              Walk.push_back(Other);
+      }
+      Headers.push_back({ Body.size(), Header });
+    }
+    std::sort(Headers.begin(), Headers.end());
+    for (auto [Size, Header] : Headers)
+    {
+      // Longest trip from the header back to it, in topological order
+      const std::set<Word>& Body = Bodies[Header];
+      std::map<Word, u64> Longest;
+      u64 Trip = 0;
+      for (auto it = Finished.rbegin(); it != Finished.rend(); ++it)
+      {
+        if (!Body.count(*it))
+          continue;
+        u64 Reached = *it == Header ? 0 : Longest[*it];
+        if (*it != Header && !Reached)
+          continue;
+        Reached += Weight[*it].worst;
+        for (Word Successor : Blocks[*it].successors)
+        {
+          if (Successor == Header)
+            Trip = std::max(Trip, Reached);
+          else if (Body.count(Successor) && forward(*it, Successor))
+            Longest[Successor] = std::max(Longest[Successor], Reached);
+        }
+      }
+      Weight[Header].worst += (u64)(loop_bounds[Header] - 1) * Trip;
+    }
+
+    // Cycles from each block to the exits, successors first
+    std::map<Word, ROUTINE_BOUNDS> FromBlock;
+    for (Word Start : Finished)
+    {
+      const BASIC_BLOCK& Block = Blocks[Start];
+      ROUTINE_BOUNDS& From = FromBlock[Start];
+      if (Block.halts)
+        From.to_halt = Weight[Start];
+      if (Block.returns)
+        From.to_return = Weight[Start];
+      CYCLE_BOUNDS Own = { true, Block.best, Block.worst };
+      if (Block.call >= 0)
+        From.to_halt.merge(chain(Own, Calls[Start]->to_halt));
+      for (Word Successor : Block.successors)
+      {
+        if (!forward(Start, Successor) || !State[Successor])
+          continue;
+        From.to_halt.merge(chain(Weight[Start], FromBlock[Successor].to_halt));
+        From.to_return.merge(chain(Weight[Start], FromBlock[Successor].to_return));
+      }
+    }
+    Bounds.to_halt = FromBlock[entry].to_halt;
+    Bounds.to_return = FromBlock[entry].to_return;
+    return routines[entry] = Bounds;
+  }
+
+  void WCET_ESTIMATOR::report(FILE* out) const
+  {
+    fprintf(out, "%-8s %-8s %12s %12s\n", "routine", "exit", "best", "worst");
+    for (auto& [Entry, Bounds] : routines)
+    {
+      if (!Bounds.bounded())
+      {
+        fprintf(out, "$%04X    unbounded: %s\n", Entry, Bounds.problem.c_str());
+        continue;
+      }
+      if (Bounds.to_halt.reachable)
+        fprintf(out, "$%04X    %-8s %12llu %12llu\n", Entry, "halt", Bounds.to_halt.best, Bounds.to_halt.worst);
+      if (Bounds.to_return.reachable)
+        fprintf(out, "$%04X    %-8s %12llu %12llu\n", Entry, "return", Bounds.to_return.best, Bounds.to_return.worst);
+      if (!Bounds.to_halt.reachable && !Bounds.to_return.reachable)
+        fprintf(out, "$%04X    never halts or returns\n", Entry);
+    }
+  }
+
+  int wcet_command(int argc, char** argv)
+  {
+    u32 LoadAddress, Measure = 0;
+    const char* BoundsPath = nullptr;
+    bool Undocumented = false;
+    bool Valid = argc >= 3 && parse_number(argv[1], LoadAddress) && LoadAddress < MAX_MEM;
+    for (int i = 3; Valid && i < argc; i++)
+    {
+      if (strcmp(argv[i], "--undocumented") == 0)
+        Undocumented = true;
+      else if (strcmp(argv[i], "--bounds") == 0 && i + 1 < argc)
+        BoundsPath = argv[++i];
+      else if (strcmp(argv[i], "--measure") == 0 && i + 1 < argc)
+        Valid = parse_number(argv[++i], Measure) && Measure > 0 && Measure <= 0x7FFFFFFF;
+      else
+        Valid = false;
+    }
+    if (!Valid)
+    {
+      fprintf(stderr, "usage: emulator wcet <rom> <load address> <entry>[,<entry>...] [--bounds file] [--measure cycles]"
+                      " [--undocumented]\n"
+                      "bounds file lines: <loop header address> <most iterations>\n");
+      return 1;
+    }
+
+    static MEM memory;
+    memory.initialize();
+    u32 RomSize = memory.load_program(argv[0], LoadAddress);
+    if (!RomSize)
+    {
+      fprintf(stderr, "can't load %s at $%04X\n", argv[0], LoadAddress);
+      return 1;
+    }
+    WCET_ESTIMATOR Estimator(memory, LoadAddress, RomSize);
+    Estimator.undocumented = Undocumented;
+    if (BoundsPath)
+    {
+      FILE* File = fopen(BoundsPath, "r");
+      bool Read = File && Estimator.read_bounds(File);
+      if (File)
+        fclose(File);
+      if (!Read)
+      {
+        fprintf(stderr, "can't read the bounds in %s\n", BoundsPath);
+        return 1;
+      }
+    }
+
+    std::vector<Word> Entries;
+    for (char* Entry = strtok(argv[2], ","); Entry; Entry = strtok(nullptr, ","))
+    {
+      u32 Address;
+      if (!parse_number(Entry, Address) || Address >= MAX_MEM)
+      {
+        fprintf(stderr, "invalid entry point: %s\n", Entry);
+        return 1;
+      }
+      Entries.push_back(Address);
+      Estimator.analyze(Address);
+    }
+    Estimator.report(stdout);
+    if (!Measure)
+      return 0;
+
+    // Cross-check: a run from each entry must halt within the bounds of its halting paths
+    bool Consistent = true;
+    static MEM RunMemory;
+    CPU cpu;
+    for (Word Entry : Entries)
+    {
+      cpu.reset(RunMemory);
+      memcpy(RunMemory.Data, memory.Data, MAX_MEM);
+      cpu.PC = Entry;
+      cpu.illegal_opcode_policy = Undocumented ? illegal_opcode_policies::UNDOCUMENTED : illegal_opcode_policies::HALT;
+      EXEC_RESULT Result = cpu.exec(Measure, RunMemory);
+      const ROUTINE_BOUNDS& Bounds = Estimator.routines[Entry];
+      if (Result.reason == halt_reasons::BUDGET_EXHAUSTED)
+      {
+        printf("$%04X measured: still running after %d cycles\n", Entry, Result.cycles);
+        continue;
+      }
+      bool Within = Bounds.bounded() && Bounds.to_halt.reachable && (u64)Result.cycles >= Bounds.to_halt.best &&
+                    (u64)Result.cycles <= Bounds.to_halt.worst;
+      printf("$%04X measured: %d cycles, %s\n", Entry, Result.cycles,
+             !Bounds.bounded() ? "no bounds to check" : Within ? "within the bounds" : "OUTSIDE THE BOUNDS");
+      Consistent &= Within || !Bounds.bounded();
+    }
+    return Consistent ? 0 : 1;
+  }
+}
\ No newline at end of file